@@ -196,6 +196,10 @@ SOURCE=.\buckets\apr_buckets_refcount.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\buckets\apr_buckets_shm.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\buckets\apr_buckets_simple.c
 # End Source File
 # Begin Source File
@@ -433,6 +437,10 @@ SOURCE=.\memcache\apr_memcache.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -664,6 +672,10 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
@@ -894,6 +906,10 @@ SOURCE=.\include\apr_atomic.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_dso.h
 # End Source File
 # Begin Source File
@@ -1059,6 +1075,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -54,16 +54,28 @@ APR_DECLARE(apr_status_t) apr_brigade_cleanup(void *data)
     return APR_SUCCESS;
 }
 
+static APR_INLINE apr_status_t brigade_cleanup_run(apr_bucket_brigade *b)
+{
+    apr_pool_cleanup_t *cleanup = b->cleanup;
+
+    /* Kill the cleanup once only, its handle gets recycled */
+    if (cleanup == NULL) {
+        return apr_brigade_cleanup(b);
+    }
+    b->cleanup = NULL;
+    return apr_pool_cleanup_run_handle(b->p, cleanup);
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_destroy(apr_bucket_brigade *b)
 {
 #ifndef APR_BUCKET_DEBUG
-    return apr_pool_cleanup_run(b->p, b, brigade_cleanup);
+    return brigade_cleanup_run(b);
 #else
     apr_status_t rv;
     
     APR_BRIGADE_CHECK_CONSISTENCY(b);
 
-    rv = apr_pool_cleanup_run(b->p, b, brigade_cleanup);
+    rv = brigade_cleanup_run(b);
 
     /* Trigger consistency check failures if the brigade is
      * re-used. */
@@ -85,7 +97,8 @@ APR_DECLARE(apr_bucket_brigade *) apr_brigade_create(apr_pool_t *p,
 
     APR_RING_INIT(&b->list, apr_bucket, link);
 
-    apr_pool_cleanup_register(b->p, b, brigade_cleanup, apr_pool_cleanup_null);
+    b->cleanup = apr_pool_cleanup_register_handle(b->p, b, brigade_cleanup,
+                                                  apr_pool_cleanup_null);
     return b;
 }
 
@@ -379,6 +392,263 @@ APR_DECLARE(apr_status_t) apr_brigade_split_line(apr_bucket_brigade *bbOut,
     return APR_SUCCESS;
 }
 
+/* Word at a time search of the delimiters: some byte of a word is equal
+ * to the delimiter if the same byte of (word ^ pattern) is zero, which
+ * HAS_ZERO() tells for all the bytes of the word at once.
+ */
+#define WORD_ONES   ((apr_size_t)-1 / 0xFF)
+#define WORD_HIGHS  (WORD_ONES * 0x80)
+#define HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+
+static const char *find_delim(const char *str, apr_size_t len,
+                              const apr_brigade_delims_t *delims)
+{
+    const char *end = str + len;
+    apr_size_t patterns[APR_BRIGADE_DELIMS_MAX];
+    int i, n = delims->nbytes;
+
+    if (n == 1) {
+        return memchr(str, delims->bytes[0], len);
+    }
+
+    for (i = 0; i < n; i++) {
+        patterns[i] = WORD_ONES * (unsigned char)delims->bytes[i];
+    }
+    while (end - str >= (apr_ssize_t)sizeof(apr_size_t)) {
+        apr_size_t word, found = 0;
+
+        memcpy(&word, str, sizeof(word));
+        for (i = 0; i < n; i++) {
+            found |= HAS_ZERO(word ^ patterns[i]);
+        }
+        if (found) {
+            break;
+        }
+        str += sizeof(word);
+    }
+    for (; str < end; str++) {
+        for (i = 0; i < n; i++) {
+            if (*str == delims->bytes[i]) {
+                return str;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_line_find(apr_bucket_brigade *bb,
+                                           const apr_brigade_delims_t *delims,
+                                           apr_read_type_e block,
+                                           apr_off_t maxbytes,
+                                           apr_brigade_line_t *line)
+{
+    apr_bucket *e;
+    const char *str, *pos;
+    apr_size_t len, off;
+    apr_status_t rv;
+    int cr = 0;
+
+    memset(line, 0, sizeof(*line));
+
+    if (delims->nbytes < 1 || delims->nbytes > APR_BRIGADE_DELIMS_MAX) {
+        return APR_EINVAL;
+    }
+
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e))
+    {
+        rv = apr_bucket_read(e, &str, &len, block);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        off = 0;
+        while ((pos = find_delim(str + off, len - off, delims)) != NULL) {
+            off = pos - str + 1;
+            if (*pos == APR_ASCII_LF) {
+                /* The CR may be at the end of the previous bucket */
+                if (pos > str ? pos[-1] == APR_ASCII_CR : cr) {
+                    line->delim_len = 2;
+                }
+                else if (delims->crlf) {
+                    continue;
+                }
+                else {
+                    line->delim_len = 1;
+                }
+            }
+            else {
+                line->delim_len = 1;
+            }
+            line->length += off;
+            line->end = e;
+            line->end_offset = off;
+            return APR_SUCCESS;
+        }
+
+        if (len) {
+            cr = (str[len - 1] == APR_ASCII_CR);
+        }
+        line->length += len;
+        line->end = e;
+        line->end_offset = len;
+        /* No delimiter within the maximum line length. */
+        if (line->length >= maxbytes) {
+            break;
+        }
+    }
+
+    return APR_INCOMPLETE;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_split_delims(apr_bucket_brigade *bbOut,
+                                           apr_bucket_brigade *bbIn,
+                                           const apr_brigade_delims_t *delims,
+                                           apr_read_type_e block,
+                                           apr_off_t maxbytes)
+{
+    apr_brigade_line_t line;
+    apr_bucket *first;
+    apr_status_t rv;
+
+    rv = apr_brigade_line_find(bbIn, delims, block, maxbytes, &line);
+
+    if (line.end) {
+        if (line.end_offset < line.end->length) {
+            apr_status_t srv = apr_bucket_split(line.end, line.end_offset);
+            if (srv != APR_SUCCESS) {
+                return srv;
+            }
+        }
+        first = APR_BRIGADE_FIRST(bbIn);
+        APR_RING_UNSPLICE(first, line.end, link);
+        APR_RING_SPLICE_TAIL(&bbOut->list, first, line.end, apr_bucket, link);
+
+        APR_BRIGADE_CHECK_CONSISTENCY(bbIn);
+        APR_BRIGADE_CHECK_CONSISTENCY(bbOut);
+    }
+
+    return (rv == APR_INCOMPLETE) ? APR_SUCCESS : rv;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_transfer_to_alloc(
+                                             apr_bucket_brigade *bbOut,
+                                             apr_bucket_brigade *bbIn)
+{
+    apr_bucket *e, *h;
+    const char *str;
+    apr_size_t len;
+    apr_status_t rv;
+
+    while (!APR_BRIGADE_EMPTY(bbIn)) {
+        e = APR_BRIGADE_FIRST(bbIn);
+
+        /* The mmaps are tied to the producer's pool (cleanups) */
+        if (APR_BUCKET_IS_TRANSIENT(e) || APR_BUCKET_IS_POOL(e)
+                || APR_BUCKET_IS_MMAP(e)) {
+            rv = apr_bucket_read(e, &str, &len, APR_BLOCK_READ);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            h = apr_bucket_heap_create(str, len, NULL, e->list);
+            APR_BUCKET_INSERT_BEFORE(e, h);
+            apr_bucket_delete(e);
+            e = h;
+        }
+        else if (e->type->copy == apr_bucket_shared_copy) {
+            ((apr_bucket_refcount *)e->data)->atomic = 1;
+
+            if (APR_BUCKET_IS_FILE(e)) {
+                /* Positional reads only: no mmap in the producer's pool,
+                 * nor readahead state updated by both threads */
+                apr_bucket_file *a = e->data;
+#if APR_HAS_MMAP
+                a->can_mmap = 0;
+#endif
+                a->readahead = 0;
+            }
+        }
+
+        e->list = bbOut->bucket_alloc;
+        APR_BUCKET_REMOVE(e);
+        APR_BRIGADE_INSERT_TAIL(bbOut, e);
+    }
+
+    return APR_SUCCESS;
+}
+
+#define IS_MEMORY_BUCKET(e) (APR_BUCKET_IS_HEAP(e) \
+                             || APR_BUCKET_IS_TRANSIENT(e) \
+                             || APR_BUCKET_IS_POOL(e) \
+                             || APR_BUCKET_IS_IMMORTAL(e))
+
+APR_DECLARE(apr_status_t) apr_brigade_coalesce(apr_bucket_brigade *bb,
+                                               apr_size_t target,
+                                               apr_size_t *merged)
+{
+    apr_bucket *e, *first, *next, *h;
+    apr_size_t total, count = 0;
+    const char *str;
+    apr_size_t len;
+    apr_status_t rv = APR_SUCCESS;
+    char *buf = NULL;
+    int n;
+
+    if (target == 0) {
+        target = APR_BUCKET_BUFF_SIZE;
+    }
+
+    e = APR_BRIGADE_FIRST(bb);
+    while (e != APR_BRIGADE_SENTINEL(bb)) {
+        /* The run of memory buckets fitting in the target size */
+        first = e;
+        total = 0;
+        n = 0;
+        while (e != APR_BRIGADE_SENTINEL(bb) && IS_MEMORY_BUCKET(e)
+               && e->length < target && total + e->length <= target) {
+            total += e->length;
+            n++;
+            e = APR_BUCKET_NEXT(e);
+        }
+        if (n < 2) {
+            if (n == 0) {
+                e = APR_BUCKET_NEXT(e);
+            }
+            continue;
+        }
+
+        if (total) {
+            buf = apr_bucket_alloc(total, bb->bucket_alloc);
+            if (buf == NULL) {
+                rv = APR_ENOMEM;
+                break;
+            }
+            h = apr_bucket_heap_create(buf, total, apr_bucket_free,
+                                       bb->bucket_alloc);
+            APR_BUCKET_INSERT_BEFORE(first, h);
+        }
+
+        for (; first != e; first = next) {
+            next = APR_BUCKET_NEXT(first);
+            /* Reading memory buckets does not fail */
+            apr_bucket_read(first, &str, &len, APR_BLOCK_READ);
+            if (len) {
+                memcpy(buf, str, len);
+                buf += len;
+            }
+            apr_bucket_delete(first);
+        }
+        count += n;
+    }
+
+    if (merged) {
+        *merged = count;
+    }
+
+    return rv;
+}
 
 APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b, 
                                                struct iovec *vec, int *nvec)
@@ -412,6 +682,199 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
     return APR_SUCCESS;
 }
 
+/* File buckets smaller than this are cheaper to read and send along with
+ * the other buckets than with a sendfile() call of their own.
+ */
+#define SEND_BRIGADE_MIN_SENDFILE   256
+
+/* Don't read more than this into memory before sending it. */
+#define SEND_BRIGADE_MAX_BYTES      (1024 * 1024)
+
+/* Remove the first len bytes of the brigade, along with the metadata
+ * buckets up to the first byte not sent.
+ */
+static apr_status_t brigade_consume(apr_bucket_brigade *bb, apr_size_t len)
+{
+    apr_bucket *e;
+    apr_status_t rv;
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        if (e->length > len) {
+            if (len) {
+                rv = apr_bucket_split(e, len);
+                if (rv != APR_SUCCESS)
+                    return rv;
+                apr_bucket_delete(e);
+            }
+            break;
+        }
+        len -= e->length;
+        apr_bucket_delete(e);
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_socket_send_brigade(apr_socket_t *sock,
+                                                  apr_bucket_brigade *bb,
+                                                  apr_size_t *len)
+{
+    struct iovec vec[APR_MAX_IOVEC_SIZE];
+    apr_bucket *e, *file, *splice;
+    apr_size_t nbytes, sent;
+    int nvec, corked = 0, cork_set = 0, cork_tried = 0, can_splice = 1;
+    apr_status_t rv = APR_SUCCESS, arv;
+
+    *len = 0;
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        const char *data;
+        apr_size_t n;
+
+        /* Gather the data up to the first file bucket to sendfile(), or
+         * the first pipe or socket bucket to splice.
+         */
+        nvec = 0;
+        nbytes = 0;
+        file = splice = NULL;
+        for (e = APR_BRIGADE_FIRST(bb);
+             e != APR_BRIGADE_SENTINEL(bb)
+             && nvec < APR_MAX_IOVEC_SIZE
+             && nbytes < SEND_BRIGADE_MAX_BYTES;
+             e = APR_BUCKET_NEXT(e))
+        {
+            if (APR_BUCKET_IS_METADATA(e)) {
+                continue;
+            }
+            if (can_splice && APR_BUCKET_CAN_SPLICE(e)) {
+                if (!nvec) {
+                    splice = e;
+                }
+                break;
+            }
+#if APR_HAS_SENDFILE
+            if (APR_BUCKET_IS_FILE(e)
+                && e->length >= SEND_BRIGADE_MIN_SENDFILE
+                && (apr_file_flags_get(((apr_bucket_file *)e->data)->fd)
+                    & APR_FOPEN_SENDFILE_ENABLED)) {
+                file = e;
+                break;
+            }
+#endif
+            /* Don't wait for more (pipe or socket) data while there is
+             * some to send already.
+             */
+            rv = apr_bucket_read(e, &data, &n,
+                                 nvec ? APR_NONBLOCK_READ : APR_BLOCK_READ);
+            if (APR_STATUS_IS_EAGAIN(rv)) {
+                rv = APR_SUCCESS;
+                break;
+            }
+            if (rv != APR_SUCCESS) {
+                goto done;
+            }
+            if (n) {
+                vec[nvec].iov_base = (void *)data;
+                vec[nvec].iov_len = n;
+                nvec++;
+                nbytes += n;
+            }
+        }
+
+        if (splice) {
+            sent = SEND_BRIGADE_MAX_BYTES;
+            rv = apr_bucket_splice(splice, sock, &sent, APR_BLOCK_READ);
+            *len += sent;
+            if (rv == APR_ENOTIMPL) {
+                /* Read it then */
+                can_splice = 0;
+                rv = APR_SUCCESS;
+            }
+            else if (rv != APR_SUCCESS) {
+                goto done;
+            }
+            continue;
+        }
+
+#if APR_HAS_SENDFILE
+        if (file) {
+            apr_hdtr_t hdtr;
+            apr_off_t offset = file->start;
+
+            /* Cork the socket while there is more than one segment */
+            if (!cork_tried) {
+                for (e = APR_BUCKET_NEXT(file);
+                     e != APR_BRIGADE_SENTINEL(bb);
+                     e = APR_BUCKET_NEXT(e)) {
+                    if (!APR_BUCKET_IS_METADATA(e)) {
+                        break;
+                    }
+                }
+                if (nvec || e != APR_BRIGADE_SENTINEL(bb)) {
+                    apr_int32_t on = 0;
+
+                    cork_tried = 1;
+                    apr_socket_opt_get(sock, APR_TCP_NOPUSH, &on);
+                    if (on) {
+                        corked = 1;
+                    }
+                    else if (apr_socket_opt_set(sock, APR_TCP_NOPUSH,
+                                                1) == APR_SUCCESS) {
+                        corked = cork_set = 1;
+                    }
+                }
+            }
+
+            /* Without corking (e.g. not a TCP socket), sendfile() would
+             * fail to send the iovecs as headers, so send them first.
+             */
+            if (!nvec || corked) {
+                memset(&hdtr, 0, sizeof(hdtr));
+                hdtr.headers = vec;
+                hdtr.numheaders = nvec;
+
+                sent = file->length;
+                rv = apr_socket_sendfile(sock,
+                                         ((apr_bucket_file *)file->data)->fd,
+                                         &hdtr, &offset, &sent, 0);
+                *len += sent;
+                arv = brigade_consume(bb, sent);
+                if (rv == APR_SUCCESS) {
+                    rv = arv;
+                }
+                if (rv != APR_SUCCESS) {
+                    goto done;
+                }
+                continue;
+            }
+        }
+#endif
+
+        if (nvec) {
+            rv = apr_socket_sendv(sock, vec, nvec, &sent);
+        }
+        else {
+            sent = 0;
+        }
+        *len += sent;
+        arv = brigade_consume(bb, sent);
+        if (rv == APR_SUCCESS) {
+            rv = arv;
+        }
+        if (rv != APR_SUCCESS) {
+            goto done;
+        }
+    }
+
+done:
+    if (cork_set) {
+        apr_socket_opt_set(sock, APR_TCP_NOPUSH, 0);
+    }
+
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_vputstrs(apr_bucket_brigade *b, 
                                                apr_brigade_flush flush,
                                                void *ctx,
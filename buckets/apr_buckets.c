@@ -15,6 +15,9 @@
  */
 
 #include "apr_buckets.h"
+#include "apr_hash.h"
+
+#include "apr_buckets_internal.h"
 
 APR_DECLARE_NONSTD(apr_status_t) apr_bucket_setaside_noop(apr_bucket *data,
                                                           apr_pool_t *pool)
@@ -44,3 +47,97 @@ APR_DECLARE_NONSTD(void) apr_bucket_destroy_noop(void *data)
 {
     return;
 }
+
+APR_DECLARE(apr_status_t) apr_bucket_splice(apr_bucket *e, apr_socket_t *sock,
+                                            apr_size_t *len,
+                                            apr_read_type_e block)
+{
+    if (!APR_BUCKET_CAN_SPLICE(e)) {
+        *len = 0;
+        return APR_ENOTIMPL;
+    }
+    return e->type->splice(e, sock, len, block);
+}
+
+/* The read sizes of the streams of a pool, by stream */
+#define READ_SIZES_KEY "apr_bucket_read_sizes"
+#define READ_SIZE_MIN 1024
+
+apr_bucket_read_size_t *apr_bucket_read_size_get(apr_pool_t *pool,
+                                                 const void *stream,
+                                                 int create)
+{
+    apr_bucket_read_size_t *rs;
+    apr_hash_t *sizes = NULL;
+
+    apr_pool_userdata_get((void **)&sizes, READ_SIZES_KEY, pool);
+    if (sizes == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        sizes = apr_hash_make(pool);
+        apr_pool_userdata_setn(sizes, READ_SIZES_KEY, NULL, pool);
+    }
+
+    rs = apr_hash_get(sizes, &stream, sizeof(stream));
+    if (rs == NULL && create) {
+        rs = apr_palloc(pool, sizeof(*rs));
+        rs->stream = stream;
+        rs->size = APR_BUCKET_BUFF_SIZE;
+        rs->max = APR_BUCKET_READ_MAX_DEFAULT;
+        apr_hash_set(sizes, &rs->stream, sizeof(rs->stream), rs);
+    }
+    return rs;
+}
+
+apr_size_t apr_bucket_read_size_next(apr_bucket_alloc_t *list,
+                                     const apr_bucket_read_size_t *rs)
+{
+    apr_size_t size;
+
+    size = apr_bucket_alloc_aligned_floor(list, rs ? rs->size
+                                                   : APR_BUCKET_BUFF_SIZE);
+    if (rs && size > rs->max) {
+        size = rs->max;
+    }
+    return size;
+}
+
+void apr_bucket_read_size_adapt(apr_pool_t *pool, const void *stream,
+                                apr_bucket_read_size_t *rs,
+                                apr_size_t size, apr_size_t len)
+{
+    apr_size_t max = rs ? rs->max : APR_BUCKET_READ_MAX_DEFAULT;
+    apr_size_t next = size;
+
+    if (len == size) {
+        next = (size < max / 2) ? size * 2 : max;
+    }
+    else if (len < size / 2 && size > APR_BUCKET_BUFF_SIZE) {
+        next = (size / 2 > APR_BUCKET_BUFF_SIZE) ? size / 2
+                                                 : APR_BUCKET_BUFF_SIZE;
+    }
+    if (next != size) {
+        if (rs == NULL) {
+            rs = apr_bucket_read_size_get(pool, stream, 1);
+        }
+        rs->size = next;
+    }
+}
+
+void apr_bucket_read_size_max_set(apr_pool_t *pool, const void *stream,
+                                  apr_size_t max)
+{
+    apr_bucket_read_size_t *rs = apr_bucket_read_size_get(pool, stream, 1);
+
+    if (max == 0) {
+        max = APR_BUCKET_READ_MAX_DEFAULT;
+    }
+    else if (max < READ_SIZE_MIN) {
+        max = READ_SIZE_MIN;
+    }
+    rs->max = max;
+    if (rs->size > max) {
+        rs->size = max;
+    }
+}
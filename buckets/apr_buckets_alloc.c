@@ -19,6 +19,12 @@
 #include "apr_buckets.h"
 #include "apr_allocator.h"
 #include "apr_support.h"
+#if APR_HAS_THREADS
+#include "apr_atomic.h"
+#include "apr_portable.h"
+#endif
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
 
 #define ALLOC_AMT (8192 - APR_MEMNODE_T_SIZE)
 
@@ -32,6 +38,14 @@ typedef struct node_header_t {
 #define SIZEOF_NODE_HEADER_T  APR_ALIGN_DEFAULT(sizeof(node_header_t))
 #define SMALL_NODE_SIZE       (APR_BUCKET_ALLOC_SIZE + SIZEOF_NODE_HEADER_T)
 
+/* The memnodes of the larger allocations (e.g. the read buffers of the
+ * file, pipe and socket buckets) are cached by size classes of CACHE_UNIT
+ * bytes, up to CACHE_SLOTS * CACHE_UNIT, rather than going back to the
+ * allocator each time.
+ */
+#define CACHE_UNIT            4096
+#define CACHE_SLOTS           16
+
 /** A list of free memory from which new buckets or private bucket
  *  structures can be allocated.
  */
@@ -40,8 +54,50 @@ struct apr_bucket_alloc_t {
     apr_allocator_t *allocator;
     node_header_t *freelist;
     apr_memnode_t *blocks;
+    /** The cached memnodes of (slot + 1) * CACHE_UNIT bytes or more */
+    apr_memnode_t *cache[CACHE_SLOTS];
+    apr_size_t cache_bytes;
+    apr_size_t cache_max;
+    apr_size_t large_allocs;
+    apr_size_t large_hits;
+#if APR_HAS_THREADS
+    /** Whether the memory may be freed by other threads than the owner */
+    int shared;
+    apr_os_thread_t owner;
+    /** The memory freed by the other threads, for the owner to take back */
+    void *volatile remote;
+#endif
 };
 
+static void cache_free(apr_bucket_alloc_t *list)
+{
+    apr_size_t i;
+
+    for (i = 0; i < CACHE_SLOTS; i++) {
+        if (list->cache[i]) {
+            apr_allocator_free(list->allocator, list->cache[i]);
+            list->cache[i] = NULL;
+        }
+    }
+    list->cache_bytes = 0;
+}
+
+#if APR_HAS_THREADS
+static void node_free(apr_bucket_alloc_t *list, node_header_t *node);
+
+/* Take back the memory freed by the other threads */
+static void remote_drain(apr_bucket_alloc_t *list)
+{
+    node_header_t *node, *next;
+
+    node = apr_atomic_xchgptr(&list->remote, NULL);
+    for (; node; node = next) {
+        next = node->next;
+        node_free(list, node);
+    }
+}
+#endif
+
 static apr_status_t alloc_cleanup(void *data)
 {
     apr_bucket_alloc_t *list = data;
@@ -55,6 +111,10 @@ static apr_status_t alloc_cleanup(void *data)
     }
 #endif
 
+#if APR_HAS_THREADS
+    remote_drain(list);
+#endif
+    cache_free(list);
     apr_allocator_free(list->allocator, list->blocks);
 
 #if APR_POOL_DEBUG
@@ -107,10 +167,10 @@ APR_DECLARE_NONSTD(apr_bucket_alloc_t *) apr_bucket_alloc_create_ex(
         return NULL;
     }
     list = (apr_bucket_alloc_t *)block->first_avail;
-    list->pool = NULL;
+    memset(list, 0, sizeof(*list));
     list->allocator = allocator;
-    list->freelist = NULL;
     list->blocks = block;
+    list->cache_max = APR_BUCKET_ALLOC_CACHE_MAX_DEFAULT;
     block->first_avail += APR_ALIGN_DEFAULT(sizeof(*list));
     APR_VALGRIND_NOACCESS(block->first_avail,
                           block->endp - block->first_avail);
@@ -123,6 +183,10 @@ APR_DECLARE_NONSTD(void) apr_bucket_alloc_destroy(apr_bucket_alloc_t *list)
         apr_pool_cleanup_kill(list->pool, list, alloc_cleanup);
     }
 
+#if APR_HAS_THREADS
+    remote_drain(list);
+#endif
+    cache_free(list);
     apr_allocator_free(list->allocator, list->blocks);
 
 #if APR_POOL_DEBUG
@@ -160,6 +224,12 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t in_size,
     char *endp;
     apr_size_t size;
 
+#if APR_HAS_THREADS
+    if (list->remote) {
+        remote_drain(list);
+    }
+#endif
+
     size = in_size + SIZEOF_NODE_HEADER_T;
     if (size <= SMALL_NODE_SIZE) {
         if (list->freelist) {
@@ -191,10 +261,26 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t in_size,
         }
     }
     else {
-        apr_memnode_t *memnode = apr_allocator_alloc(list->allocator, size);
-        if (!memnode) {
-            return NULL;
+        apr_memnode_t *memnode = NULL;
+        apr_size_t slot;
+
+        slot = (apr_allocator_align(list->allocator, size) + CACHE_UNIT - 1)
+               / CACHE_UNIT - 1;
+        if (slot < CACHE_SLOTS && (memnode = list->cache[slot]) != NULL) {
+            list->cache[slot] = memnode->next;
+            memnode->next = NULL;
+            list->cache_bytes -= memnode->endp - (char *)memnode;
+            list->large_hits++;
+            APR_VALGRIND_UNDEFINED(memnode->first_avail,
+                                   memnode->endp - memnode->first_avail);
+        }
+        else {
+            memnode = apr_allocator_alloc(list->allocator, size);
+            if (!memnode) {
+                return NULL;
+            }
         }
+        list->large_allocs++;
         node = (node_header_t *)memnode->first_avail;
         node->alloc = list;
         node->memnode = memnode;
@@ -223,18 +309,99 @@ static void check_not_already_free(node_header_t *node)
 #define check_not_already_free(node)
 #endif
 
-APR_DECLARE_NONSTD(void) apr_bucket_free(void *mem)
+static void node_free(apr_bucket_alloc_t *list, node_header_t *node)
 {
-    node_header_t *node = (node_header_t *)((char *)mem - SIZEOF_NODE_HEADER_T);
-    apr_bucket_alloc_t *list = node->alloc;
-
     if (node->size == SMALL_NODE_SIZE) {
         check_not_already_free(node);
         node->next = list->freelist;
         list->freelist = node;
-        APR_VALGRIND_NOACCESS(mem, SMALL_NODE_SIZE - SIZEOF_NODE_HEADER_T);
+        APR_VALGRIND_NOACCESS((char *)node + SIZEOF_NODE_HEADER_T,
+                              SMALL_NODE_SIZE - SIZEOF_NODE_HEADER_T);
     }
     else {
-        apr_allocator_free(list->allocator, node->memnode);
+        apr_memnode_t *memnode = node->memnode;
+        apr_size_t total = memnode->endp - (char *)memnode;
+        apr_size_t slot = total / CACHE_UNIT - 1;
+
+        if (slot < CACHE_SLOTS && list->cache_bytes + total <= list->cache_max) {
+            memnode->next = list->cache[slot];
+            list->cache[slot] = memnode;
+            list->cache_bytes += total;
+            APR_VALGRIND_NOACCESS(memnode->first_avail,
+                                  memnode->endp - memnode->first_avail);
+        }
+        else {
+            apr_allocator_free(list->allocator, memnode);
+        }
     }
 }
+
+APR_DECLARE_NONSTD(void) apr_bucket_free(void *mem)
+{
+    node_header_t *node = (node_header_t *)((char *)mem - SIZEOF_NODE_HEADER_T);
+    apr_bucket_alloc_t *list = node->alloc;
+
+#if APR_HAS_THREADS
+    if (list->shared
+        && !apr_os_thread_equal(list->owner, apr_os_thread_current())) {
+        void *head;
+
+        /* Not our memory, queue it for the owner */
+        do {
+            head = list->remote;
+            node->next = head;
+        } while (apr_atomic_casptr(&list->remote, node, head) != head);
+        return;
+    }
+#endif
+
+    node_free(list, node);
+}
+
+APR_DECLARE_NONSTD(void) apr_bucket_alloc_cache_max_set(
+                                             apr_bucket_alloc_t *list,
+                                             apr_size_t size)
+{
+    list->cache_max = size;
+    if (list->cache_bytes > size) {
+        cache_free(list);
+    }
+}
+
+APR_DECLARE_NONSTD(void) apr_bucket_alloc_stats_get(
+                                             apr_bucket_alloc_t *list,
+                                             apr_bucket_alloc_stats_t *stats)
+{
+    apr_memnode_t *memnode;
+    node_header_t *node;
+    apr_size_t i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (memnode = list->blocks; memnode; memnode = memnode->next) {
+        stats->blocks++;
+    }
+    for (node = list->freelist; node; node = node->next) {
+        stats->small_free++;
+    }
+    stats->large_allocs = list->large_allocs;
+    stats->large_hits = list->large_hits;
+    for (i = 0; i < CACHE_SLOTS; i++) {
+        for (memnode = list->cache[i]; memnode; memnode = memnode->next) {
+            stats->large_cached++;
+        }
+    }
+    stats->large_cached_bytes = list->cache_bytes;
+}
+
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_shared_set(
+                                             apr_bucket_alloc_t *list)
+{
+#if APR_HAS_THREADS
+    list->owner = apr_os_thread_current();
+    list->shared = 1;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
@@ -45,6 +45,7 @@ static int file_make_mmap(apr_bucket *e, apr_size_t filelength,
                            apr_off_t fileoffset, apr_pool_t *p)
 {
     apr_bucket_file *a = e->data;
+    apr_int32_t flags = APR_MMAP_READ;
     apr_mmap_t *mm;
 
     if (!a->can_mmap) {
@@ -52,47 +53,82 @@ static int file_make_mmap(apr_bucket *e, apr_size_t filelength,
     }
 
     if (filelength > APR_MMAP_LIMIT) {
-        if (apr_mmap_create(&mm, a->fd, fileoffset, APR_MMAP_LIMIT,
-                            APR_MMAP_READ, p) != APR_SUCCESS)
-        {
-            return 0;
-        }
-        apr_bucket_split(e, APR_MMAP_LIMIT);
         filelength = APR_MMAP_LIMIT;
     }
-    else if ((filelength < APR_MMAP_THRESHOLD) ||
-             (apr_mmap_create(&mm, a->fd, fileoffset, filelength,
-                              APR_MMAP_READ, p) != APR_SUCCESS))
-    {
+    else if (filelength < APR_MMAP_THRESHOLD) {
         return 0;
     }
+    if (filelength <= a->populate_max) {
+        flags |= APR_MMAP_POPULATE;
+    }
+    if (apr_mmap_create(&mm, a->fd, fileoffset, filelength,
+                        flags, p) != APR_SUCCESS) {
+        return 0;
+    }
+    if (a->readahead && !(flags & APR_MMAP_POPULATE)) {
+        apr_mmap_advise(mm, 0, filelength, APR_FADVISE_SEQUENTIAL);
+        apr_mmap_advise(mm, 0, (filelength < (apr_size_t)a->readahead)
+                               ? filelength : (apr_size_t)a->readahead,
+                        APR_FADVISE_WILLNEED);
+    }
+    if (filelength < e->length) {
+        apr_bucket_split(e, filelength);
+    }
     apr_bucket_mmap_make(e, mm, 0, filelength);
     file_bucket_destroy(a);
     return 1;
 }
 #endif
 
-static apr_status_t file_bucket_read(apr_bucket *e, const char **str,
-                                     apr_size_t *len, apr_read_type_e block)
+/* Keep the system reading the file at least half a window ahead of us */
+static void file_readahead(apr_bucket_file *a, apr_off_t fileoffset,
+                           apr_size_t filelength)
+{
+    apr_off_t end;
+
+    if (!a->readahead) {
+        return;
+    }
+
+    if (a->advised < 0) {
+        /* Not worth it for a single read */
+        if (filelength <= a->read_size) {
+            return;
+        }
+        if (apr_file_advise(a->fd, fileoffset, filelength,
+                            APR_FADVISE_SEQUENTIAL) != APR_SUCCESS) {
+            a->readahead = 0;
+            return;
+        }
+        a->advised = fileoffset;
+    }
+    else if (a->advised < fileoffset) {
+        a->advised = fileoffset;
+    }
+    else if (a->advised - fileoffset >= a->readahead / 2) {
+        return;
+    }
+
+    end = fileoffset + ((filelength < (apr_size_t)a->readahead)
+                        ? (apr_off_t)filelength : a->readahead);
+    if (end > a->advised) {
+        apr_file_advise(a->fd, a->advised, end - a->advised,
+                        APR_FADVISE_WILLNEED);
+        a->advised = end;
+    }
+}
+
+/* Read from the file's position, for the platforms without positional
+ * reads.
+ */
+static apr_status_t file_read_seek(apr_bucket_file *a, char *buf,
+                                   apr_size_t *len, apr_off_t fileoffset)
 {
-    apr_bucket_file *a = e->data;
     apr_file_t *f = a->fd;
-    apr_bucket *b = NULL;
-    char *buf;
     apr_status_t rv;
-    apr_size_t filelength = e->length;  /* bytes remaining in file past offset */
-    apr_off_t fileoffset = e->start;
 #if APR_HAS_THREADS && !APR_HAS_XTHREAD_FILES
     apr_int32_t flags;
-#endif
 
-#if APR_HAS_MMAP
-    if (file_make_mmap(e, filelength, fileoffset, a->readpool)) {
-        return apr_bucket_read(e, str, len, block);
-    }
-#endif
-
-#if APR_HAS_THREADS && !APR_HAS_XTHREAD_FILES
     if ((flags = apr_file_flags_get(f)) & APR_FOPEN_XTHREAD) {
         /* this file descriptor is shared across multiple threads and
          * this OS doesn't support that natively, so as a workaround
@@ -108,17 +144,47 @@ static apr_status_t file_bucket_read(apr_bucket *e, const char **str,
     }
 #endif
 
-    *str = NULL;  /* in case we die prematurely */
-    *len = (filelength > a->read_size) ? a->read_size : filelength;
-    buf = apr_bucket_alloc(*len, e->list);
-
     /* Handle offset ... */
     rv = apr_file_seek(f, APR_SET, &fileoffset);
     if (rv != APR_SUCCESS) {
-        apr_bucket_free(buf);
         return rv;
     }
-    rv = apr_file_read(f, buf, len);
+    return apr_file_read(f, buf, len);
+}
+
+static apr_status_t file_bucket_read(apr_bucket *e, const char **str,
+                                     apr_size_t *len, apr_read_type_e block)
+{
+    apr_bucket_file *a = e->data;
+    apr_bucket *b = NULL;
+    char *buf;
+    apr_status_t rv;
+    apr_size_t size;
+    apr_size_t filelength = e->length;  /* bytes remaining in file past offset */
+    apr_off_t fileoffset = e->start;
+
+#if APR_HAS_MMAP
+    if (file_make_mmap(e, filelength, fileoffset, a->readpool)) {
+        return apr_bucket_read(e, str, len, block);
+    }
+#endif
+
+    file_readahead(a, fileoffset, filelength);
+
+    *str = NULL;  /* in case we die prematurely */
+    size = (filelength > a->read_size) ? a->read_size : filelength;
+    buf = apr_bucket_alloc(size, e->list);
+
+    /* A positional read neither moves the file position nor needs the
+     * file to be reopened for each thread (APR_FOPEN_XTHREAD), so the
+     * file can be shared by buckets read concurrently.
+     */
+    *len = size;
+    rv = apr_file_read_at(a->fd, buf, len, fileoffset);
+    if (rv == APR_ENOTIMPL) {
+        *len = size;
+        rv = file_read_seek(a, buf, len, fileoffset);
+    }
     if (rv != APR_SUCCESS && rv != APR_EOF) {
         apr_bucket_free(buf);
         return rv;
@@ -162,8 +228,11 @@ APR_DECLARE(apr_bucket *) apr_bucket_file_make(apr_bucket *b, apr_file_t *fd,
     f->readpool = p;
 #if APR_HAS_MMAP
     f->can_mmap = 1;
+    f->populate_max = 0;
 #endif
     f->read_size = APR_BUCKET_BUFF_SIZE;
+    f->readahead = APR_BUCKET_FILE_READAHEAD_DEFAULT;
+    f->advised = -1;
 
     b = apr_bucket_shared_make(b, f, offset, len);
     b->type = &apr_bucket_type_file;
@@ -212,6 +281,28 @@ APR_DECLARE(apr_status_t) apr_bucket_file_set_buf_size(apr_bucket *e,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_bucket_file_readahead_set(apr_bucket *e,
+                                                        apr_off_t size)
+{
+    apr_bucket_file *a = e->data;
+
+    a->readahead = (size > 0) ? size : 0;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_bucket_file_populate_set(apr_bucket *e,
+                                                       apr_size_t size)
+{
+#if APR_HAS_MMAP
+    apr_bucket_file *a = e->data;
+    a->populate_max = size;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif /* APR_HAS_MMAP */
+}
+
 static apr_status_t file_bucket_setaside(apr_bucket *data, apr_pool_t *reqpool)
 {
     apr_bucket_file *a = data->data;
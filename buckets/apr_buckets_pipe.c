@@ -14,13 +14,19 @@
  * limitations under the License.
  */
 
+#include "apr_private.h"
+
 #include "apr_buckets.h"
 
+#include "apr_buckets_internal.h"
+
 static apr_status_t pipe_bucket_read(apr_bucket *a, const char **str,
                                      apr_size_t *len, apr_read_type_e block)
 {
     apr_file_t *p = a->data;
+    apr_bucket_read_size_t *rs;
     char *buf;
+    apr_size_t size;
     apr_status_t rv;
     apr_interval_time_t timeout;
 
@@ -29,8 +35,11 @@ static apr_status_t pipe_bucket_read(apr_bucket *a, const char **str,
         apr_file_pipe_timeout_set(p, 0);
     }
 
+    rs = apr_bucket_read_size_get(apr_file_pool_get(p), p, 0);
+    size = apr_bucket_read_size_next(a->list, rs);
+
     *str = NULL;
-    *len = APR_BUCKET_BUFF_SIZE;
+    *len = size;
     buf = apr_bucket_alloc(*len, a->list); /* XXX: check for failure? */
 
     rv = apr_file_read(p, buf, len);
@@ -57,10 +66,13 @@ static apr_status_t pipe_bucket_read(apr_bucket *a, const char **str,
      */
     if (*len > 0) {
         apr_bucket_heap *h;
+
+        apr_bucket_read_size_adapt(apr_file_pool_get(p), p, rs, size, *len);
+
         /* Change the current bucket to refer to what we read */
         a = apr_bucket_heap_make(a, buf, *len, apr_bucket_free);
         h = a->data;
-        h->alloc_len = APR_BUCKET_BUFF_SIZE; /* note the real buffer size */
+        h->alloc_len = size; /* note the real buffer size */
         *str = buf;
         APR_BUCKET_INSERT_AFTER(a, apr_bucket_pipe_create(p, a->list));
     }
@@ -75,6 +87,38 @@ static apr_status_t pipe_bucket_read(apr_bucket *a, const char **str,
     return APR_SUCCESS;
 }
 
+#ifdef HAVE_SPLICE
+static apr_status_t pipe_bucket_splice(apr_bucket *a, apr_socket_t *sock,
+                                       apr_size_t *len, apr_read_type_e block)
+{
+    apr_file_t *p = a->data;
+    apr_status_t rv;
+
+    if (apr_file_flags_get(p) & APR_FOPEN_BUFFERED) {
+        /* The data in the read buffer would be skipped, read them */
+        *len = 0;
+        return APR_ENOTIMPL;
+    }
+
+    if (block == APR_BLOCK_READ) {
+        rv = apr_file_pipe_wait(p, APR_WAIT_READ);
+        if (rv != APR_SUCCESS) {
+            *len = 0;
+            return rv;
+        }
+    }
+
+    rv = apr_socket_send_pipe(sock, p, len);
+    if (rv == APR_EOF) {
+        /* Same as pipe_bucket_read() at the end */
+        apr_bucket_immortal_make(a, "", 0);
+        apr_file_close(p);
+        return APR_SUCCESS;
+    }
+    return rv;
+}
+#endif /* HAVE_SPLICE */
+
 APR_DECLARE(apr_bucket *) apr_bucket_pipe_make(apr_bucket *b, apr_file_t *p)
 {
     /*
@@ -109,11 +153,22 @@ APR_DECLARE(apr_bucket *) apr_bucket_pipe_create(apr_file_t *p,
     return apr_bucket_pipe_make(b, p);
 }
 
+APR_DECLARE(void) apr_bucket_pipe_read_max_set(apr_file_t *p,
+                                               apr_size_t max)
+{
+    apr_bucket_read_size_max_set(apr_file_pool_get(p), p, max);
+}
+
 APR_DECLARE_DATA const apr_bucket_type_t apr_bucket_type_pipe = {
-    "PIPE", 5, APR_BUCKET_DATA, 
+    "PIPE", 6, APR_BUCKET_DATA, 
     apr_bucket_destroy_noop,
     pipe_bucket_read,
     apr_bucket_setaside_notimpl,
     apr_bucket_split_notimpl,
-    apr_bucket_copy_notimpl
+    apr_bucket_copy_notimpl,
+#ifdef HAVE_SPLICE
+    pipe_bucket_splice
+#else
+    NULL
+#endif
 };
@@ -15,6 +15,17 @@
  */
 
 #include "apr_buckets.h"
+#include "apr_atomic.h"
+
+static APR_INLINE void refcount_inc(apr_bucket_refcount *r)
+{
+    if (r->atomic) {
+        apr_atomic_inc32(&r->refcount);
+    }
+    else {
+        r->refcount++;
+    }
+}
 
 APR_DECLARE_NONSTD(apr_status_t) apr_bucket_shared_split(apr_bucket *a,
                                                          apr_size_t point)
@@ -25,7 +36,7 @@ APR_DECLARE_NONSTD(apr_status_t) apr_bucket_shared_split(apr_bucket *a,
     if ((rv = apr_bucket_simple_split(a, point)) != APR_SUCCESS) {
         return rv;
     }
-    r->refcount++;
+    refcount_inc(r);
 
     return APR_SUCCESS;
 }
@@ -35,7 +46,7 @@ APR_DECLARE_NONSTD(apr_status_t) apr_bucket_shared_copy(apr_bucket *a,
 {
     apr_bucket_refcount *r = a->data;
 
-    r->refcount++;
+    refcount_inc(r);
 
     return apr_bucket_simple_copy(a, b);
 }
@@ -43,6 +54,10 @@ APR_DECLARE_NONSTD(apr_status_t) apr_bucket_shared_copy(apr_bucket *a,
 APR_DECLARE(int) apr_bucket_shared_destroy(void *data)
 {
     apr_bucket_refcount *r = data;
+
+    if (r->atomic) {
+        return (apr_atomic_dec32(&r->refcount) == 0);
+    }
     r->refcount--;
     return (r->refcount == 0);
 }
@@ -58,6 +73,7 @@ APR_DECLARE(apr_bucket *) apr_bucket_shared_make(apr_bucket *b, void *data,
     b->length = length;
     /* caller initializes the type field */
     r->refcount = 1;
+    r->atomic = 0;
 
     return b;
 }
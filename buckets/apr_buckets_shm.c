@@ -0,0 +1,135 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_buckets.h"
+#include "apr_atomic.h"
+
+/*
+ * A region starts with the count of the references to it, shared by all
+ * the processes attached to the segment.  The buckets of a process share
+ * one of these references (with the usual bucket refcount), released when
+ * the last of them is destroyed.
+ */
+typedef struct shm_region_t {
+    apr_uint32_t refs;
+} shm_region_t;
+
+#define SHM_REGION_HEADER APR_ALIGN_DEFAULT(sizeof(shm_region_t))
+
+APR_DECLARE(apr_status_t) apr_bucket_shm_region_alloc(apr_rmm_off_t *region,
+                                                      apr_rmm_t *rmm,
+                                                      apr_size_t size)
+{
+    shm_region_t *r;
+    apr_rmm_off_t off;
+
+    off = apr_rmm_malloc(rmm, SHM_REGION_HEADER + size);
+    if (!off) {
+        return APR_ENOMEM;
+    }
+    r = apr_rmm_addr_get(rmm, off);
+    apr_atomic_set32(&r->refs, 1);
+
+    *region = off;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_bucket_shm_region_addr(apr_rmm_t *rmm,
+                                               apr_rmm_off_t region)
+{
+    return (char *)apr_rmm_addr_get(rmm, region) + SHM_REGION_HEADER;
+}
+
+APR_DECLARE(void) apr_bucket_shm_region_retain(apr_rmm_t *rmm,
+                                               apr_rmm_off_t region)
+{
+    shm_region_t *r = apr_rmm_addr_get(rmm, region);
+
+    apr_atomic_inc32(&r->refs);
+}
+
+APR_DECLARE(apr_status_t) apr_bucket_shm_region_release(apr_rmm_t *rmm,
+                                                        apr_rmm_off_t region)
+{
+    shm_region_t *r = apr_rmm_addr_get(rmm, region);
+
+    if (apr_atomic_dec32(&r->refs) == 0) {
+        return apr_rmm_free(rmm, region);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t shm_bucket_read(apr_bucket *b, const char **str,
+                                    apr_size_t *length, apr_read_type_e block)
+{
+    apr_bucket_shm *s = b->data;
+
+    *str = (char *)apr_bucket_shm_region_addr(s->rmm, s->region) + b->start;
+    *length = b->length;
+    return APR_SUCCESS;
+}
+
+static void shm_bucket_destroy(void *data)
+{
+    apr_bucket_shm *s = data;
+
+    if (apr_bucket_shared_destroy(s)) {
+        apr_bucket_shm_region_release(s->rmm, s->region);
+        apr_bucket_free(s);
+    }
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_shm_make(apr_bucket *b, apr_rmm_t *rmm,
+                                              apr_rmm_off_t region,
+                                              apr_off_t start,
+                                              apr_size_t length)
+{
+    apr_bucket_shm *s;
+
+    s = apr_bucket_alloc(sizeof(*s), b->list);
+    s->rmm = rmm;
+    s->region = region;
+
+    apr_bucket_shm_region_retain(rmm, region);
+
+    b = apr_bucket_shared_make(b, s, start, length);
+    b->type = &apr_bucket_type_shm;
+
+    return b;
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_shm_create(apr_rmm_t *rmm,
+                                                apr_rmm_off_t region,
+                                                apr_off_t start,
+                                                apr_size_t length,
+                                                apr_bucket_alloc_t *list)
+{
+    apr_bucket *b = apr_bucket_alloc(sizeof(*b), list);
+
+    APR_BUCKET_INIT(b);
+    b->free = apr_bucket_free;
+    b->list = list;
+    return apr_bucket_shm_make(b, rmm, region, start, length);
+}
+
+APR_DECLARE_DATA const apr_bucket_type_t apr_bucket_type_shm = {
+    "SHM", 5, APR_BUCKET_DATA,
+    shm_bucket_destroy,
+    shm_bucket_read,
+    apr_bucket_setaside_noop,
+    apr_bucket_shared_split,
+    apr_bucket_shared_copy
+};
@@ -14,13 +14,20 @@
  * limitations under the License.
  */
 
+#include "apr_private.h"
+
 #include "apr_buckets.h"
+#include "apr_thread_proc.h"
+
+#include "apr_buckets_internal.h"
 
 static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
                                        apr_size_t *len, apr_read_type_e block)
 {
     apr_socket_t *p = a->data;
+    apr_bucket_read_size_t *rs;
     char *buf;
+    apr_size_t size;
     apr_status_t rv;
     apr_interval_time_t timeout;
 
@@ -29,8 +36,11 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
         apr_socket_timeout_set(p, 0);
     }
 
+    rs = apr_bucket_read_size_get(apr_socket_pool_get(p), p, 0);
+    size = apr_bucket_read_size_next(a->list, rs);
+
     *str = NULL;
-    *len = APR_BUCKET_BUFF_SIZE;
+    *len = size;
     buf = apr_bucket_alloc(*len, a->list); /* XXX: check for failure? */
 
     rv = apr_socket_recv(p, buf, len);
@@ -60,10 +70,13 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
      */
     if (*len > 0) {
         apr_bucket_heap *h;
+
+        apr_bucket_read_size_adapt(apr_socket_pool_get(p), p, rs, size, *len);
+
         /* Change the current bucket to refer to what we read */
         a = apr_bucket_heap_make(a, buf, *len, apr_bucket_free);
         h = a->data;
-        h->alloc_len = APR_BUCKET_BUFF_SIZE; /* note the real buffer size */
+        h->alloc_len = size; /* note the real buffer size */
         *str = buf;
         APR_BUCKET_INSERT_AFTER(a, apr_bucket_socket_create(p, a->list));
     }
@@ -75,6 +88,97 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
     return APR_SUCCESS;
 }
 
+#ifdef HAVE_SPLICE
+
+/* The pipe through which the data of a socket are spliced to another,
+ * kept with the (source) socket for its lifetime.
+ */
+#define SPLICE_PIPE_KEY "apr_bucket_socket_splice"
+
+typedef struct {
+    apr_file_t *in;
+    apr_file_t *out;
+} splice_pipe_t;
+
+static apr_status_t socket_bucket_splice(apr_bucket *a, apr_socket_t *sock,
+                                         apr_size_t *len,
+                                         apr_read_type_e block)
+{
+    apr_socket_t *p = a->data;
+    splice_pipe_t *pipe;
+    apr_size_t n, sent, max = *len;
+    apr_status_t rv;
+    apr_interval_time_t timeout;
+
+    *len = 0;
+
+    apr_socket_data_get((void **)&pipe, SPLICE_PIPE_KEY, p);
+    if (pipe == NULL) {
+        apr_pool_t *pool = apr_socket_pool_get(p);
+
+        pipe = apr_palloc(pool, sizeof(*pipe));
+        rv = apr_file_pipe_create_ex(&pipe->in, &pipe->out, APR_FULL_NONBLOCK,
+                                     pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        apr_socket_data_set(p, pipe, SPLICE_PIPE_KEY, apr_pool_cleanup_null);
+    }
+
+    if (block == APR_NONBLOCK_READ) {
+        apr_socket_timeout_get(p, &timeout);
+        apr_socket_timeout_set(p, 0);
+    }
+
+    n = max;
+    rv = apr_socket_recv_pipe(p, pipe->out, &n);
+
+    if (block == APR_NONBLOCK_READ) {
+        apr_socket_timeout_set(p, timeout);
+    }
+
+    if (rv == APR_EOF) {
+        /* Same as socket_bucket_read() at the end */
+        apr_bucket_immortal_make(a, "", 0);
+        return APR_SUCCESS;
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    while (*len < n) {
+        sent = n - *len;
+        rv = apr_socket_send_pipe(sock, pipe->in, &sent);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        *len += sent;
+    }
+
+    if (*len < n) {
+        /* The socket would block (or failed), don't leave the data in the
+         * pipe but before this bucket, with the usual heap copy.
+         */
+        apr_status_t arv;
+        apr_bucket *b;
+        char *buf;
+
+        sent = n - *len;
+        buf = apr_bucket_alloc(sent, a->list);
+        arv = apr_file_read_full(pipe->in, buf, sent, NULL);
+        if (arv != APR_SUCCESS) {
+            apr_bucket_free(buf);
+            return arv;
+        }
+        b = apr_bucket_heap_create(buf, sent, apr_bucket_free, a->list);
+        APR_BUCKET_INSERT_BEFORE(a, b);
+    }
+
+    return rv;
+}
+
+#endif /* HAVE_SPLICE */
+
 APR_DECLARE(apr_bucket *) apr_bucket_socket_make(apr_bucket *b, apr_socket_t *p)
 {
     /*
@@ -104,11 +208,22 @@ APR_DECLARE(apr_bucket *) apr_bucket_socket_create(apr_socket_t *p,
     return apr_bucket_socket_make(b, p);
 }
 
+APR_DECLARE(void) apr_bucket_socket_read_max_set(apr_socket_t *p,
+                                                 apr_size_t max)
+{
+    apr_bucket_read_size_max_set(apr_socket_pool_get(p), p, max);
+}
+
 APR_DECLARE_DATA const apr_bucket_type_t apr_bucket_type_socket = {
-    "SOCKET", 5, APR_BUCKET_DATA,
+    "SOCKET", 6, APR_BUCKET_DATA,
     apr_bucket_destroy_noop,
     socket_bucket_read,
     apr_bucket_setaside_notimpl, 
     apr_bucket_split_notimpl,
-    apr_bucket_copy_notimpl
+    apr_bucket_copy_notimpl,
+#ifdef HAVE_SPLICE
+    socket_bucket_splice
+#else
+    NULL
+#endif
 };
@@ -15,6 +15,7 @@
 #include "apr_atomic.h"
 #include "apr_base64.h"
 #include "apr_buckets.h"
+#include "apr_chash.h"
 #include "apr_date.h"
 #include "apr_dbd.h"
 #include "apr_dbm.h"
@@ -55,6 +56,7 @@
 #include "apr_signal.h"
 #include "apr_siphash.h"
 #include "apr_skiplist.h"
+#include "apr_slab.h"
 #include "apr_strings.h"
 #include "apr_strmatch.h"
 #include "apr_support.h"
@@ -148,6 +148,25 @@ APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf, apr_size
 
 
 
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile, void *buf,
+                                           apr_size_t *nbytes,
+                                           apr_off_t offset)
+{
+    *nbytes = 0;
+    return APR_ENOTIMPL;
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_advise(apr_file_t *thefile,
+                                          apr_off_t offset, apr_off_t len,
+                                          int advice)
+{
+    return APR_ENOTIMPL;
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_file_write(apr_file_t *thefile, const void *buf, apr_size_t *nbytes)
 {
     ULONG rc = 0;
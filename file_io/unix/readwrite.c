@@ -146,6 +146,84 @@ APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf, apr_size
     }
 }
 
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile, void *buf,
+                                           apr_size_t *nbytes,
+                                           apr_off_t offset)
+{
+#ifdef HAVE_PREAD
+    apr_ssize_t rv;
+
+    if (*nbytes <= 0) {
+        *nbytes = 0;
+        return APR_SUCCESS;
+    }
+
+    /* Buffered writes must hit the file first, the read buffer is left
+     * alone since the file position does not change.
+     */
+    if (thefile->buffered) {
+        file_lock(thefile);
+        rv = (thefile->direction == 1) ? apr_file_flush_locked(thefile) : 0;
+        file_unlock(thefile);
+        if (rv) {
+            *nbytes = 0;
+            return rv;
+        }
+    }
+
+    do {
+        rv = pread(thefile->filedes, buf, *nbytes, offset);
+    } while (rv == -1 && errno == EINTR);
+
+    if (rv > 0) {
+        *nbytes = rv;
+        return APR_SUCCESS;
+    }
+    *nbytes = 0;
+    if (rv == 0) {
+        return APR_EOF;
+    }
+    return errno;
+#else
+    *nbytes = 0;
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_file_advise(apr_file_t *thefile,
+                                          apr_off_t offset, apr_off_t len,
+                                          int advice)
+{
+#ifdef HAVE_POSIX_FADVISE
+    int native;
+
+    switch (advice) {
+    case APR_FADVISE_NORMAL:
+        native = POSIX_FADV_NORMAL;
+        break;
+    case APR_FADVISE_SEQUENTIAL:
+        native = POSIX_FADV_SEQUENTIAL;
+        break;
+    case APR_FADVISE_RANDOM:
+        native = POSIX_FADV_RANDOM;
+        break;
+    case APR_FADVISE_WILLNEED:
+        native = POSIX_FADV_WILLNEED;
+        break;
+    case APR_FADVISE_DONTNEED:
+        native = POSIX_FADV_DONTNEED;
+        break;
+    default:
+        return APR_EINVAL;
+    }
+
+    /* The error is returned, errno is not set */
+    return posix_fadvise(thefile->filedes, offset, len, native);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 static apr_status_t do_rotating_check(apr_file_t *thefile, apr_time_t now)
 {
     apr_size_t rv = APR_SUCCESS;
@@ -66,6 +66,22 @@ struct apr_memnode_t {
 /** Symbolic constants */
 #define APR_ALLOCATOR_MAX_FREE_UNLIMITED 0
 
+/**
+ * @defgroup apr_allocator_flags Allocator creation flags
+ * @{
+ */
+/**
+ * Carve the memnodes out of 2MB arenas backed by huge pages, explicit ones
+ * (MAP_HUGETLB) when the system has some reserved or transparent ones
+ * otherwise, to reduce the TLB misses of large and long-lived pools.
+ * @remark The memory of the arenas is never given back to the system
+ *         before the allocator is destroyed, whatever the threshold set by
+ *         apr_allocator_max_free_set().  Nodes larger than the ones
+ *         recycled in slots (20 pages) are not carved from the arenas.
+ */
+#define APR_ALLOCATOR_HUGEPAGES 0x01
+/** @} */
+
 /**
  * Create a new allocator
  * @param allocator The allocator we have just created.
@@ -74,6 +90,18 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Create a new allocator with the given flags
+ * @param allocator The allocator we have just created.
+ * @param flags A bitmask of APR_ALLOCATOR_* flags, see
+ *        @ref apr_allocator_flags
+ * @return APR_SUCCESS, APR_ENOMEM, or APR_ENOTIMPL if a flag is not
+ *         supported on this platform.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -93,6 +121,23 @@ APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
                                                  apr_size_t size)
                              __attribute__((nonnull(1)));
 
+/**
+ * Allocate a block of mem from the allocator, aligned
+ * @param allocator The allocator to allocate from
+ * @param size The size of the mem to allocate (excluding the
+ *        memnode structure and the alignment padding)
+ * @param alignment The alignment of the memnode's first_avail, a power
+ *        of two
+ * @return The memnode, or NULL if @a alignment is not a power of two or
+ *         the allocation failed
+ * @remark The memnode is given back with apr_allocator_free() as usual.
+ */
+APR_DECLARE(apr_memnode_t *) apr_allocator_alloc_aligned(
+                                                 apr_allocator_t *allocator,
+                                                 apr_size_t size,
+                                                 apr_size_t alignment)
+                             __attribute__((nonnull(1)));
+
 /**
  * Free a list of blocks of mem, giving them back to the allocator.
  * The list is typically terminated by a memnode with its next field
@@ -129,6 +174,37 @@ APR_DECLARE(apr_status_t) apr_allocator_min_order_set(unsigned int order);
 APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
                                             apr_size_t size);
 
+/** Number of free lists of an allocator, @see apr_allocator_stats_t */
+#define APR_ALLOCATOR_STATS_SLOTS 21
+
+/**
+ * Statistics of an allocator, @see apr_allocator_stats_get()
+ */
+typedef struct apr_allocator_stats_t {
+    /** Number of nodes on each free list, slot i holds nodes of (i + 1)
+     * pages and the last slot larger ones */
+    apr_size_t free_nodes[APR_ALLOCATOR_STATS_SLOTS];
+    /** Total size of the nodes on the free lists */
+    apr_size_t free_bytes;
+    /** Number of nodes given back to the system because of the threshold
+     * set by apr_allocator_max_free_set() */
+    apr_size_t max_free_hits;
+    /** Total size of the nodes on the free lists whose pages have been
+     * trimmed, @see apr_allocator_trim_set() */
+    apr_size_t trimmed_bytes;
+} apr_allocator_stats_t;
+
+/**
+ * Get the statistics of an allocator
+ * @param allocator The allocator
+ * @param stats The statistics to fill in
+ * @remark The nodes held by the thread caches (if any) are not accounted
+ *         for, @see apr_allocator_thread_cache_stats().
+ */
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
 #include "apr_pools.h"
 
 /**
@@ -165,6 +241,40 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
 
 #include "apr_thread_mutex.h"
 
+/**
+ * Set the time after which the free (idle) nodes of the allocator get
+ * their pages given back to the system, while staying mapped
+ * @param allocator The allocator to set the trimming for
+ * @param max_idle How long nodes should stay unused (on the free lists)
+ *        before being trimmed, or a negative value to disable trimming
+ *        (the default).
+ * @return APR_SUCCESS, or APR_ENOTIMPL if madvise() is not available.
+ * @remark Trimmed nodes are madvise(MADV_FREE)'d in place (or
+ *         MADV_DONTNEED where not supported), but for the page holding
+ *         their header, so they can be reused without the
+ *         cost of allocating them again.  This complements the threshold
+ *         set by apr_allocator_max_free_set(), which gives nodes back to
+ *         the system as soon as they are freed.
+ * @remark Trimming happens (at most every @a max_idle / 2 seconds) while
+ *         nodes are being freed, and when apr_allocator_trim() is called,
+ *         the granularity is one second.  Nodes of huge page arenas
+ *         (@see APR_ALLOCATOR_HUGEPAGES) or in thread caches are not
+ *         trimmed, the former being much smaller than a huge page.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_trim_set(apr_allocator_t *allocator,
+                                                 apr_interval_time_t max_idle)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Trim the free nodes of the allocator which have been idle for longer than
+ * the time set by apr_allocator_trim_set()
+ * @param allocator The allocator to trim
+ * @return The number of bytes given back to the system
+ * @remark Allows an idle process (which frees nothing) to shrink.
+ */
+APR_DECLARE(apr_size_t) apr_allocator_trim(apr_allocator_t *allocator)
+                        __attribute__((nonnull(1)));
+
 #if APR_HAS_THREADS
 /**
  * Set a mutex for the allocator to use
@@ -185,6 +295,46 @@ APR_DECLARE(apr_thread_mutex_t *) apr_allocator_mutex_get(
 
 #endif /* APR_HAS_THREADS */
 
+/**
+ * Enable (or disable) per-thread caching of the memnodes of the allocator
+ * @param allocator The allocator to set the thread cache for
+ * @param max_nodes The maximum number of nodes each thread keeps per size
+ *        slot, or 0 to disable (and empty) the thread caches.
+ * @param pool The pool the thread caches are bound to, when it is cleared
+ *        or destroyed the caches are disabled and their nodes given back to
+ *        the allocator.  Must not outlive the allocator.
+ * @return APR_SUCCESS, APR_ENOTIMPL without threads, or the error of
+ *         apr_threadkey_private_create().
+ * @remark With a thread cache, allocating and freeing nodes of a commonly
+ *         used size does not lock the allocator mutex in the steady state,
+ *         the cache being refilled or emptied by batches of half
+ *         @a max_nodes.  Nodes larger than the ones recycled in slots
+ *         (20 pages) are never cached.
+ * @remark The cached nodes are not accounted for by the threshold set with
+ *         apr_allocator_max_free_set().
+ * @remark Must not be called concurrently with allocations or frees from
+ *         other threads.  When the allocator has a mutex, it should be set
+ *         (with apr_allocator_mutex_set()) before calling this function.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_size_t max_nodes,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Get the thread cache statistics of the allocator
+ * @param allocator The allocator
+ * @param hits The number of nodes allocated from the thread caches
+ * @param misses The number of allocations the thread caches could not satisfy
+ * @remark The counters are cumulative since apr_allocator_thread_cache_set()
+ *         was first called, and approximate while other threads are running.
+ */
+APR_DECLARE(void) apr_allocator_thread_cache_stats(apr_allocator_t *allocator,
+                                                   apr_size_t *hits,
+                                                   apr_size_t *misses)
+                  __attribute__((nonnull(1,2,3)));
+
 /** @} */
 
 #ifdef __cplusplus
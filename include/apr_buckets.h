@@ -32,6 +32,7 @@
 #include "apr_mmap.h"
 #include "apr_errno.h"
 #include "apr_ring.h"
+#include "apr_rmm.h"
 #include "apr.h"
 #if APR_HAVE_SYS_UIO_H
 #include <sys/uio.h>	/* for struct iovec */
@@ -53,6 +54,10 @@ extern "C" {
 /** default bucket buffer size - 8KB minus room for memory allocator headers */
 #define APR_BUCKET_BUFF_SIZE 8000
 
+/** default maximum size of the reads of the pipe and socket buckets,
+ *  @see apr_bucket_socket_read_max_set() */
+#define APR_BUCKET_READ_MAX_DEFAULT (8 * APR_BUCKET_BUFF_SIZE)
+
 /** Determines how a bucket or brigade should be read */
 typedef enum {
     APR_BLOCK_READ,   /**< block until data becomes available */
@@ -210,6 +215,21 @@ struct apr_bucket_type_t {
      */
     apr_status_t (*copy)(apr_bucket *e, apr_bucket **c);
 
+    /**
+     * Send the next chunk of the bucket's data to a socket without copying
+     *  it through user space, for the bucket types whose data come from a
+     *  descriptor (e.g. pipe and socket buckets).  This function is
+     *  optional, it is only used when num_func is at least six and it is
+     *  not NULL.  @see apr_bucket_splice()
+     * @param e The bucket to send the data of
+     * @param sock The socket to send the data to
+     * @param len On input the maximum number of bytes to send, on output
+     *            the number of bytes sent
+     * @param block Whether to wait for the data of the bucket
+     */
+    apr_status_t (*splice)(apr_bucket *e, apr_socket_t *sock, apr_size_t *len,
+                           apr_read_type_e block);
+
 };
 
 /**
@@ -273,6 +293,9 @@ struct apr_bucket_brigade {
     APR_RING_HEAD(apr_bucket_list, apr_bucket) list;
     /** The freelist from which this bucket was allocated */
     apr_bucket_alloc_t *bucket_alloc;
+    /** The cleanup registered with the pool, killed when the brigade is
+     *  destroyed */
+    apr_pool_cleanup_t *cleanup;
 };
 
 
@@ -512,6 +535,12 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
  * @return true or false
  */
 #define APR_BUCKET_IS_POOL(e)        ((e)->type == &apr_bucket_type_pool)
+/**
+ * Determine if a bucket is a SHM bucket
+ * @param e The bucket to inspect
+ * @return true or false
+ */
+#define APR_BUCKET_IS_SHM(e)         ((e)->type == &apr_bucket_type_shm)
 
 /*
  * General-purpose reference counting for the various bucket types.
@@ -533,7 +562,11 @@ typedef struct apr_bucket_refcount apr_bucket_refcount;
  */
 struct apr_bucket_refcount {
     /** The number of references to this bucket */
-    int          refcount;
+    apr_uint32_t refcount;
+    /** Whether the references may be held by buckets of different threads,
+     *  the count being then updated atomically
+     *  (@see apr_brigade_transfer_to_alloc()) */
+    int          atomic;
 };
 
 /*  *****  Reference-counted bucket types  *****  */
@@ -607,6 +640,20 @@ struct apr_bucket_mmap {
 };
 #endif
 
+/** @see apr_bucket_shm */
+typedef struct apr_bucket_shm apr_bucket_shm;
+/**
+ * A bucket referring to a region of shared memory
+ */
+struct apr_bucket_shm {
+    /** Number of buckets using this region (in this process) */
+    apr_bucket_refcount  refcount;
+    /** The shared memory the region is allocated from */
+    apr_rmm_t *rmm;
+    /** The region, @see apr_bucket_shm_region_alloc() */
+    apr_rmm_off_t region;
+};
+
 /** @see apr_bucket_file */
 typedef struct apr_bucket_file apr_bucket_file;
 /**
@@ -624,9 +671,16 @@ struct apr_bucket_file {
     /** Whether this bucket should be memory-mapped if
      *  a caller tries to read from it */
     int can_mmap;
+    /** The maximum size of the mmaps to prefault */
+    apr_size_t populate_max;
 #endif /* APR_HAS_MMAP */
     /** File read block size */
     apr_size_t read_size;
+    /** The size of the readahead window, 0 if disabled */
+    apr_off_t readahead;
+    /** The offset up to which the file was advised to be read ahead,
+     *  -1 before the first read */
+    apr_off_t advised;
 };
 
 /** @see apr_bucket_structs */
@@ -643,6 +697,7 @@ union apr_bucket_structs {
     apr_bucket_mmap mmap;   /**< MMap */
 #endif
     apr_bucket_file file;   /**< File */
+    apr_bucket_shm  shm;    /**< Shared memory */
 };
 
 /**
@@ -790,6 +845,130 @@ APR_DECLARE(apr_status_t) apr_brigade_split_line(apr_bucket_brigade *bbOut,
                                                  apr_off_t maxbytes)
                           __attribute__((nonnull(1,2)));
 
+/** The maximum number of delimiters of an apr_brigade_delims_t */
+#define APR_BRIGADE_DELIMS_MAX 4
+
+/**
+ * The delimiters ending a line, @see apr_brigade_line_find()
+ */
+typedef struct apr_brigade_delims_t {
+    /** The bytes ending a line (e.g. LF, or LF and NUL) */
+    char bytes[APR_BRIGADE_DELIMS_MAX];
+    /** The number of bytes used in @a bytes, 1 to #APR_BRIGADE_DELIMS_MAX */
+    int nbytes;
+    /** Whether an LF only ends a line when it follows a CR (strict CRLF
+     *  protocols), provided LF is one of the @a bytes */
+    int crlf;
+} apr_brigade_delims_t;
+
+/**
+ * The end of a line at the start of a brigade, @see apr_brigade_line_find()
+ */
+typedef struct apr_brigade_line_t {
+    /** The length of the line, delimiter included */
+    apr_off_t length;
+    /** The length of the delimiter (a CR before an LF counts), 0 if the
+     *  line is incomplete */
+    apr_size_t delim_len;
+    /** The bucket where the line ends, NULL if the brigade is empty */
+    apr_bucket *end;
+    /** The offset in the data of @a end right after the line */
+    apr_size_t end_offset;
+} apr_brigade_line_t;
+
+/**
+ * Find the end of the line at the start of a brigade, without moving nor
+ * copying anything (although the buckets are read, so they may morph).
+ * The search for the delimiters is done a word at a time.
+ * @param bb The bucket brigade to search
+ * @param delims The delimiters ending a line
+ * @param block The blocking mode to be used to read the buckets
+ * @param maxbytes The maximum bytes to search.  If this many bytes are seen
+ *                 without a delimiter, the line is incomplete (ending
+ *                 with the bucket where the limit was reached).
+ * @param line On return, where the line ends
+ * @return APR_SUCCESS if a delimiter was found, APR_INCOMPLETE if the end
+ *         of the brigade or @a maxbytes were reached first, APR_EINVAL if
+ *         @a delims is invalid, or the error from reading a bucket.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_line_find(apr_bucket_brigade *bb,
+                                           const apr_brigade_delims_t *delims,
+                                           apr_read_type_e block,
+                                           apr_off_t maxbytes,
+                                           apr_brigade_line_t *line)
+                          __attribute__((nonnull(1,2,5)));
+
+/**
+ * Split a brigade to represent one line ended by any of the given
+ * delimiters.  Unlike apr_brigade_split_line(), the buckets are moved to
+ * @a bbOut as they are, the small ones are not copied.
+ * @param bbOut The bucket brigade that will have the line appended to.
+ * @param bbIn The input bucket brigade to search for a line.
+ * @param delims The delimiters ending a line
+ * @param block The blocking mode to be used to split the line.
+ * @param maxbytes The maximum bytes to read.  If this many bytes are seen
+ *                 without a delimiter, @a bbOut will contain a partial line.
+ * @return APR_SUCCESS, even when the line is partial (like
+ *         apr_brigade_split_line()), or the same errors as
+ *         apr_brigade_line_find(), in which case what was read is moved
+ *         to @a bbOut anyway.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_split_delims(apr_bucket_brigade *bbOut,
+                                           apr_bucket_brigade *bbIn,
+                                           const apr_brigade_delims_t *delims,
+                                           apr_read_type_e block,
+                                           apr_off_t maxbytes)
+                          __attribute__((nonnull(1,2,3)));
+
+/**
+ * Move the buckets of a brigade to another one whose bucket allocator is
+ * owned by another thread, so that a producer thread can hand its data to
+ * a consumer thread without copying it.  The buckets are rehomed to the
+ * allocator of @a bbOut (the allocations they need from then on are made
+ * there), and the references of the shared buckets become atomic so that
+ * the copies kept by the producer can be used concurrently.  The
+ * transient, pool and mmap buckets, whose data belongs to the producer
+ * (or its pool), are copied to heap buckets.  The file buckets are no
+ * longer memory-mapped nor read ahead, by the consumer or the producer,
+ * so that they are read with apr_file_read_at() without using the
+ * producer's pool.
+ * @param bbOut The brigade to append the buckets to, not in use by any
+ *              other thread (e.g. a brigade created for the handoff)
+ * @param bbIn The brigade to move the buckets from, which is empty on
+ *             return
+ * @return APR_SUCCESS, or the error from reading a bucket to copy, the
+ *         buckets not moved yet being left in @a bbIn.
+ * @remark This must be called by the thread owning @a bbIn, the allocators
+ *         of its buckets being set with apr_bucket_alloc_shared_set(),
+ *         since the consumer will free the memory they come from.  The
+ *         resources of the other buckets (files...) must outlive their
+ *         use by the consumer.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_transfer_to_alloc(
+                                             apr_bucket_brigade *bbOut,
+                                             apr_bucket_brigade *bbIn)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Merge the runs of adjacent small memory buckets (heap, transient, pool
+ * and immortal ones) of a brigade into heap buckets of up to a target
+ * size, to reduce the number of iovecs or writes needed to send it.
+ * Other buckets are left untouched, and split the runs: the file and
+ * mmap ones are sent without copying (sendfile, mmap), and the metadata
+ * ones (flush, eos...) mark where the data before them must be written.
+ * @param bb The bucket brigade to coalesce
+ * @param target The maximum size of the merged buckets, or 0 for
+ *               #APR_BUCKET_BUFF_SIZE.  Buckets at least this large are
+ *               not merged.
+ * @param merged If not NULL, on return the number of buckets merged
+ * @return APR_SUCCESS, or APR_ENOMEM if a buffer could not be allocated,
+ *         the brigade being still consistent.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_coalesce(apr_bucket_brigade *bb,
+                                               apr_size_t target,
+                                               apr_size_t *merged)
+                          __attribute__((nonnull(1)));
+
 /**
  * Create an iovec of the elements in a bucket_brigade... return number 
  * of elements used.  This is useful for writing to a file or to the
@@ -803,6 +982,31 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
                                                struct iovec *vec, int *nvec)
                           __attribute__((nonnull(1,2,3)));
 
+/**
+ * Send the content of a bucket brigade to a socket, with as few system
+ * calls as possible.  The data buckets are gathered into iovecs (up to
+ * #APR_MAX_IOVEC_SIZE) and written at once, while the file buckets opened
+ * with #APR_FOPEN_SENDFILE_ENABLED are sent with apr_socket_sendfile(),
+ * the preceding iovecs as headers, the socket being corked in between
+ * (#APR_TCP_NOPUSH) if it is not already.  The data of the buckets which
+ * can, like pipe and socket buckets, are moved with apr_bucket_splice().
+ * @param sock The socket to send the data over
+ * @param bb The bucket brigade to send.  The buckets sent are removed from
+ *           it, along with the metadata buckets, and a bucket partially
+ *           sent is split so that only the remaining data is left.
+ * @param len On return, the number of bytes sent
+ * @return APR_SUCCESS if the whole brigade was sent (and is empty), or the
+ *         error which stopped the sending, for instance APR_EAGAIN (or
+ *         APR_TIMEUP) when the socket would block (or timed out).  The
+ *         brigade then holds what is left to send.
+ * @remark The pipe and socket buckets are not waited for while there is
+ *         some data to send already.
+ */
+APR_DECLARE(apr_status_t) apr_socket_send_brigade(apr_socket_t *sock,
+                                                  apr_bucket_brigade *bb,
+                                                  apr_size_t *len)
+                          __attribute__((nonnull(1,2,3)));
+
 /**
  * This function writes a list of strings into a bucket brigade. 
  * @param b The bucket brigade to add to
@@ -1021,6 +1225,69 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t size,
 APR_DECLARE_NONSTD(void) apr_bucket_free(void *block)
                          __attribute__((nonnull(1)));
 
+/**
+ * The default maximum size of the memory kept in the cache of a bucket
+ * allocator, @see apr_bucket_alloc_cache_max_set()
+ */
+#define APR_BUCKET_ALLOC_CACHE_MAX_DEFAULT (64 * 1024)
+
+/**
+ * Statistics of a bucket allocator, @see apr_bucket_alloc_stats_get()
+ */
+typedef struct apr_bucket_alloc_stats_t {
+    /** Number of blocks the small allocations are carved from */
+    apr_size_t blocks;
+    /** Number of small allocations in the free list */
+    apr_size_t small_free;
+    /** Number of allocations larger than APR_BUCKET_ALLOC_SIZE */
+    apr_size_t large_allocs;
+    /** Number of them served from the cache, without the apr_allocator_t */
+    apr_size_t large_hits;
+    /** Number of large blocks in the cache */
+    apr_size_t large_cached;
+    /** Size of the large blocks in the cache */
+    apr_size_t large_cached_bytes;
+} apr_bucket_alloc_stats_t;
+
+/**
+ * Set the maximum size of the memory a bucket allocator keeps in its cache.
+ * The large allocations (up to 64KB, like the read buffers of the file,
+ * pipe and socket buckets) are cached by size classes when they are freed,
+ * so that they can be reused without going through the apr_allocator_t.
+ * @param list The bucket allocator
+ * @param size The maximum size of the cache, 0 to disable it
+ */
+APR_DECLARE_NONSTD(void) apr_bucket_alloc_cache_max_set(
+                                             apr_bucket_alloc_t *list,
+                                             apr_size_t size)
+                         __attribute__((nonnull(1)));
+
+/**
+ * Get the statistics of a bucket allocator
+ * @param list The bucket allocator
+ * @param stats The statistics
+ */
+APR_DECLARE_NONSTD(void) apr_bucket_alloc_stats_get(
+                                             apr_bucket_alloc_t *list,
+                                             apr_bucket_alloc_stats_t *stats)
+                         __attribute__((nonnull(1,2)));
+
+/**
+ * Let the memory allocated from a bucket allocator be freed by other
+ * threads than the calling one, which owns the allocator.  The memory
+ * freed by the other threads is queued without locking, and taken back
+ * by the owner on its next allocation, so that the buckets allocated
+ * here can be handed to another thread (@see
+ * apr_brigade_transfer_to_alloc()).  Only the owner may still allocate
+ * from it, and destroy it once all the memory was freed and the other
+ * threads are done with it (e.g. joined).
+ * @param list The bucket allocator
+ * @return APR_SUCCESS, or APR_ENOTIMPL without threads.
+ */
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_shared_set(
+                                             apr_bucket_alloc_t *list)
+                                 __attribute__((nonnull(1)));
+
 
 /*  *****  Bucket Functions  *****  */
 /**
@@ -1146,6 +1413,42 @@ APR_DECLARE_NONSTD(void) apr_bucket_free(void *block)
  */
 #define apr_bucket_copy(e,c) (e)->type->copy(e, c)
 
+/**
+ * Determine if a bucket can send its data with apr_bucket_splice(), the
+ * pipe and socket buckets only having a splice function on the platforms
+ * that can splice
+ * @param e The bucket to inspect
+ * @return true or false
+ */
+#define APR_BUCKET_CAN_SPLICE(e) \
+    ((e)->type->num_func > 5 && (e)->type->splice != NULL)
+
+/**
+ * Send the next chunk of data of a bucket to a socket without copying it
+ * through user space (e.g. with splice() on Linux), rather than with
+ * apr_bucket_read() and apr_socket_send().
+ *
+ * Like apr_bucket_read() would, the data sent are removed from the bucket,
+ * which still represents the rest of them.  At the end of the data, the
+ * bucket is turned into an empty IMMORTAL bucket and *len is 0.
+ * @param e The bucket to send the data of
+ * @param sock The socket to send the data to
+ * @param len On input the maximum number of bytes to send, on output
+ *            the number of bytes sent
+ * @param block Whether to wait for the data of the bucket
+ * @return APR_SUCCESS, APR_ENOTIMPL if the bucket type or the platform
+ *         can't do it (the bucket is left untouched), APR_EAGAIN if
+ *         there is no data to send yet or if the socket would block, or
+ *         an error code.
+ * @remark If the socket would block after some data were taken from the
+ *         bucket's descriptor, these data are inserted before the bucket
+ *         in a HEAP bucket, so nothing is lost.
+ */
+APR_DECLARE(apr_status_t) apr_bucket_splice(apr_bucket *e, apr_socket_t *sock,
+                                            apr_size_t *len,
+                                            apr_read_type_e block)
+                          __attribute__((nonnull(1,2,3)));
+
 /* Bucket type handling */
 
 /**
@@ -1244,6 +1547,12 @@ APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_mmap;
  * the data is copied on to the heap.
  */
 APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_pool;
+/**
+ * The SHM bucket type.  This bucket represents data in a region of shared
+ * memory, which stays allocated while some process has buckets referring
+ * to it.
+ */
+APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_shm;
 /**
  * The PIPE bucket type.  This bucket represents a pipe to another program.
  */
@@ -1543,6 +1852,92 @@ APR_DECLARE(apr_bucket *) apr_bucket_mmap_make(apr_bucket *b, apr_mmap_t *mm,
                           __attribute__((nonnull(1,2)));
 #endif
 
+/**
+ * Allocate a region of shared memory for SHM buckets.  The region is
+ * reference counted across the processes attached to the memory, the
+ * caller holding the first reference.
+ * @param region The new region
+ * @param rmm The shared memory to allocate the region from, whose lock
+ *            must work across processes if several of them allocate.
+ * @param size The size of the data of the region
+ * @return APR_SUCCESS, or APR_ENOMEM if there is not enough memory left
+ * @remark The references are updated with the apr_atomic functions, which
+ *         must then be native (not emulated with mutexes).
+ */
+APR_DECLARE(apr_status_t) apr_bucket_shm_region_alloc(apr_rmm_off_t *region,
+                                                      apr_rmm_t *rmm,
+                                                      apr_size_t size)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Get the address of the data of a region of shared memory
+ * @param rmm The shared memory the region was allocated from
+ * @param region The region
+ * @return The address of the data in this process
+ */
+APR_DECLARE(void *) apr_bucket_shm_region_addr(apr_rmm_t *rmm,
+                                               apr_rmm_off_t region)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Add a reference to a region of shared memory, for instance before
+ * handing it over to another process
+ * @param rmm The shared memory the region was allocated from
+ * @param region The region
+ */
+APR_DECLARE(void) apr_bucket_shm_region_retain(apr_rmm_t *rmm,
+                                               apr_rmm_off_t region)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Release a reference to a region of shared memory, freeing it if it was
+ * the last one
+ * @param rmm The shared memory the region was allocated from
+ * @param region The region
+ * @return APR_SUCCESS, or the error from freeing the region
+ */
+APR_DECLARE(apr_status_t) apr_bucket_shm_region_release(apr_rmm_t *rmm,
+                                                        apr_rmm_off_t region)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Create a bucket referring to data in a region of shared memory.  The
+ * data can be written from there without being copied (it is a memory
+ * bucket, gathered by apr_brigade_to_iovec() for instance), and the
+ * bucket holds a reference to the region until it is destroyed.
+ * @param rmm The shared memory the region was allocated from
+ * @param region The region, @see apr_bucket_shm_region_alloc()
+ * @param start The offset of the first byte in the data of the region
+ *              that this bucket refers to
+ * @param length The number of bytes referred to by this bucket
+ * @param list The freelist from which this bucket should be allocated
+ * @return The new bucket, or NULL if allocation failed
+ * @remark The shared memory must stay attached while the bucket exists.
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_shm_create(apr_rmm_t *rmm,
+                                                apr_rmm_off_t region,
+                                                apr_off_t start,
+                                                apr_size_t length,
+                                                apr_bucket_alloc_t *list)
+                          __attribute__((nonnull(1,5)));
+
+/**
+ * Make the bucket passed in a bucket refer to data in a region of shared
+ * memory
+ * @param b The bucket to make into a SHM bucket
+ * @param rmm The shared memory the region was allocated from
+ * @param region The region
+ * @param start The offset of the first byte in the data of the region
+ *              that this bucket refers to
+ * @param length The number of bytes referred to by this bucket
+ * @return The new bucket, or NULL if allocation failed
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_shm_make(apr_bucket *b, apr_rmm_t *rmm,
+                                              apr_rmm_off_t region,
+                                              apr_off_t start,
+                                              apr_size_t length)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * Create a bucket referring to a socket.
  * @param thissock The socket to put in the bucket
@@ -1562,6 +1957,20 @@ APR_DECLARE(apr_bucket *) apr_bucket_socket_make(apr_bucket *b,
                                                  apr_socket_t *thissock)
                           __attribute__((nonnull(1,2)));
 
+/**
+ * Set the maximum size of the reads of the socket buckets referring to
+ * a socket.  The size of the reads adapts to the traffic: it grows (up to
+ * this maximum) while the reads fill the buffer, and shrinks back (down
+ * to @a APR_BUCKET_BUFF_SIZE, where it starts) when they don't fill half
+ * of it.
+ * @param thissock The socket
+ * @param max The maximum size of the reads (at least 1KB), or 0 for the
+ *            default (@a APR_BUCKET_READ_MAX_DEFAULT)
+ */
+APR_DECLARE(void) apr_bucket_socket_read_max_set(apr_socket_t *thissock,
+                                                 apr_size_t max)
+                  __attribute__((nonnull(1)));
+
 /**
  * Create a bucket referring to a pipe.
  * @param thispipe The pipe to put in the bucket
@@ -1582,6 +1991,17 @@ APR_DECLARE(apr_bucket *) apr_bucket_pipe_make(apr_bucket *b,
                                                apr_file_t *thispipe)
                           __attribute__((nonnull(1,2)));
 
+/**
+ * Set the maximum size of the reads of the pipe buckets referring to
+ * a pipe, @see apr_bucket_socket_read_max_set()
+ * @param thispipe The pipe
+ * @param max The maximum size of the reads, or 0 for the default
+ *            (@a APR_BUCKET_READ_MAX_DEFAULT)
+ */
+APR_DECLARE(void) apr_bucket_pipe_read_max_set(apr_file_t *thispipe,
+                                               apr_size_t max)
+                  __attribute__((nonnull(1)));
+
 /**
  * Create a bucket referring to a file.
  * @param fd The file to put in the bucket
@@ -1643,6 +2063,42 @@ APR_DECLARE(apr_status_t) apr_bucket_file_enable_mmap(apr_bucket *b,
 APR_DECLARE(apr_status_t) apr_bucket_file_set_buf_size(apr_bucket *b,
                                                        apr_size_t size);
 
+/**
+ * The default readahead window of the FILE buckets, @see
+ * apr_bucket_file_readahead_set()
+ */
+#define APR_BUCKET_FILE_READAHEAD_DEFAULT (256 * 1024)
+
+/**
+ * Set the readahead window of a FILE bucket (default is
+ * #APR_BUCKET_FILE_READAHEAD_DEFAULT).  When the file is read by blocks,
+ * the system is told that it is read sequentially and to read the next
+ * window ahead of time, again whenever less than half a window is left
+ * ahead of the reads.  When it is memory-mapped, the mmap is advised the
+ * same way.
+ * @param b The bucket
+ * @param size The size of the window, 0 to disable the hints
+ * @return APR_SUCCESS normally, or an error code if the operation fails
+ * @remark The file and its splits share the window.
+ */
+APR_DECLARE(apr_status_t) apr_bucket_file_readahead_set(apr_bucket *b,
+                                                        apr_off_t size)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Prefault the small memory-mapped FILE buckets (default is none)
+ * @param b The bucket
+ * @param size The maximum size of the mmaps to prefault when they are
+ *             created, 0 for none
+ * @return APR_SUCCESS normally, APR_ENOTIMPL without mmap support
+ * @remark Worth it for small hot files, whose pages are cached already,
+ *         since it saves the page faults at the cost of mapping all the
+ *         pages upfront.
+ */
+APR_DECLARE(apr_status_t) apr_bucket_file_populate_set(apr_bucket *b,
+                                                       apr_size_t size)
+                          __attribute__((nonnull(1)));
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -0,0 +1,145 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_CHASH_H
+#define APR_CHASH_H
+
+/**
+ * @file apr_chash.h
+ * @brief APR Concurrent Hash Tables
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_chash Concurrent Hash Tables
+ * @ingroup APR
+ * Hash tables which can be used by multiple threads at once.  The keys
+ * are spread over shards, each one being an apr_hash_t with its own
+ * read/write lock and pool, so that threads mostly work on different
+ * shards and lookups of the same shard do not exclude each other.  Each
+ * shard expands on its own.
+ * @{
+ */
+
+/** Opaque concurrent hash table */
+typedef struct apr_chash_t apr_chash_t;
+
+/**
+ * Create a concurrent hash table
+ * @param ht The new hash table
+ * @param shards The number of shards, rounded up to a power of two, or 0
+ *               for the default (64)
+ * @param hash_func A custom hash function, or NULL for the default one
+ * @param flags Bit-wise or of the APR_HASH_* flags for the shards, or 0,
+ *              see apr_hash_make_ex()
+ * @param pool The pool to allocate the hash table out of
+ * @return APR_SUCCESS, or the error creating the locks or pools
+ * @remark Like with apr_hash_t, the keys and values are not copied, so
+ *         they must live as long as they are in the table, and as long as
+ *         other threads may be using the values gotten from it.
+ * @remark The memory of the entries is taken from a pool of each shard,
+ *         with its own allocator, not from @a pool.
+ */
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **ht,
+                                           unsigned int shards,
+                                           apr_hashfunc_t hash_func,
+                                           apr_uint32_t flags,
+                                           apr_pool_t *pool);
+
+/**
+ * Associate a value with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *             string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the hash entry is deleted.
+ */
+APR_DECLARE(void) apr_chash_set(apr_chash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *             string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table,
+ * or if none exists associate a value, atomically.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *             string length.
+ * @param val Value to associate with the key (if none exists).
+ * @return Returns the existing value if any, the given value otherwise.
+ * @remark If the given value is NULL and a hash entry exists, nothing
+ *         is done.
+ */
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val);
+
+/**
+ * Get the number of key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table, which may
+ *         already have changed if other threads are modifying it.
+ */
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht);
+
+/**
+ * Clear any key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ */
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht);
+
+/**
+ * Iterate over a concurrent hash table running the provided function
+ * once for every element in the hash table.  The @a comp function will
+ * be invoked for every element in the hash table.
+ *
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @remark Each shard is read locked while iterating over it, so @a comp
+ *         must not modify the table; other threads can modify the shards
+ *         not being iterated.
+ */
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_CHASH_H */
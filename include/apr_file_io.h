@@ -462,6 +462,53 @@ APR_DECLARE(apr_status_t) apr_file_open_flags_stdin(apr_file_t **thefile,
 APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf,
                                         apr_size_t *nbytes);
 
+/**
+ * Read data from the specified file at the given offset, without using
+ * nor changing the file position.
+ * @param thefile The file descriptor to read from.
+ * @param buf The buffer to store the data to.
+ * @param nbytes On entry, the number of bytes to read; on exit, the number
+ *               of bytes read.
+ * @param offset The offset in the file to read from.
+ *
+ * @remark Unlike apr_file_seek() and apr_file_read(), this can be used by
+ * multiple threads at once on the same file (a single system call).  The
+ * read buffer and the char put back via ungetc of a buffered file are not
+ * used, pending buffered writes are flushed first.
+ *
+ * @remark #APR_EOF is returned at or beyond the end of the file, and
+ * #APR_ENOTIMPL on platforms without positional reads.
+ */
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile, void *buf,
+                                           apr_size_t *nbytes,
+                                           apr_off_t offset);
+
+/**
+ * @defgroup apr_file_advise Access pattern hints
+ * @see apr_file_advise(), apr_mmap_advise()
+ * @{
+ */
+#define APR_FADVISE_NORMAL     0 /**< No particular access pattern */
+#define APR_FADVISE_SEQUENTIAL 1 /**< Sequential access, read ahead more */
+#define APR_FADVISE_RANDOM     2 /**< Random access, do not read ahead */
+#define APR_FADVISE_WILLNEED   3 /**< The data will be accessed soon */
+#define APR_FADVISE_DONTNEED   4 /**< The data will not be accessed soon */
+/** @} */
+
+/**
+ * Tell the system how a range of a file will be accessed, so that it can
+ * read it ahead of time or drop it from the cache.
+ * @param thefile The file
+ * @param offset The start of the range
+ * @param len The length of the range, 0 for up to the end of the file
+ * @param advice One of the APR_FADVISE_* hints
+ * @remark This is only a hint, #APR_ENOTIMPL is returned on platforms
+ *         without posix_fadvise().
+ */
+APR_DECLARE(apr_status_t) apr_file_advise(apr_file_t *thefile,
+                                          apr_off_t offset, apr_off_t len,
+                                          int advice);
+
 /**
  * Write data to the specified file.
  * @param thefile The file descriptor to write to.
@@ -65,11 +65,40 @@ typedef struct apr_hash_index_t apr_hash_index_t;
 typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 
 /**
- * The default hash function.
+ * The "times 33" hash function, which was the one of apr_hash_make()
+ * up to APR 1.x.  It reads the key one byte at a time.
  */
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * The hash function of apr_hash_make(), with a seed of 0.  It is based on
+ * XXH64, reading the key one word at a time.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *key,
+                                                   apr_ssize_t *klen);
+
+/**
+ * @defgroup apr_hash_flags Hash table flags
+ * @see apr_hash_make_ex()
+ * @{
+ */
+/** Use the "times 33" hash function (seeded), see apr_hashfunc_default() */
+#define APR_HASH_TIMES33        0x01
+/**
+ * Use open addressing: the entries are stored in a flat array and probed
+ * a group of control bytes at a time, so that a lookup usually touches a
+ * single cache line of entries.  Better suited to read-mostly tables.
+ */
+#define APR_HASH_FLAT           0x02
+/**
+ * Expand the table incrementally: both arrays are kept while the entries
+ * are moved, a few buckets at each insertion, so that no insertion has
+ * to rehash the whole table.  Not applicable with APR_HASH_FLAT.
+ */
+#define APR_HASH_INCREMENTAL    0x04
+/** @} */
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
@@ -86,6 +115,31 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool);
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool, 
                                                apr_hashfunc_t hash_func);
 
+/**
+ * Create a hash table with some options
+ * @param pool The pool to allocate the hash table out of
+ * @param flags Bit-wise or of the APR_HASH_* flags, or 0
+ * @return The hash table just created
+ * @remark The hash function is seeded randomly for each table, as with
+ *         apr_hash_make().
+ * @remark The API and semantics are the same whatever the flags, notably
+ *         the current entry can be removed while iterating.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_uint32_t flags);
+
+/**
+ * Create a hash table with a custom hash function and some options
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function.
+ * @param flags Bit-wise or of the APR_HASH_* flags, or 0
+ * @return The hash table just created
+ * @remark APR_HASH_TIMES33 has no effect with a custom hash function.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_custom_ex(apr_pool_t *pool,
+                                                  apr_hashfunc_t hash_func,
+                                                  apr_uint32_t flags);
+
 /**
  * Make a copy of a hash table
  * @param pool The pool from which to allocate the new hash table
@@ -46,6 +46,8 @@ extern "C" {
 #define APR_MMAP_READ    1
 /** MMap opened for writing */
 #define APR_MMAP_WRITE   2
+/** MMap prefaulted at creation (where supported), for small hot files */
+#define APR_MMAP_POPULATE 4
 
 /** @see apr_mmap_t */
 typedef struct apr_mmap_t            apr_mmap_t;
@@ -127,6 +129,7 @@ struct apr_mmap_t {
  * <PRE>
  *          APR_MMAP_READ       MMap opened for reading
  *          APR_MMAP_WRITE      MMap opened for writing
+ *          APR_MMAP_POPULATE   MMap prefaulted (read ahead) at creation
  * </PRE>
  * @param cntxt The pool to use when creating the mmap.
  */
@@ -160,6 +163,19 @@ APR_DECLARE(apr_status_t) apr_mmap_delete(apr_mmap_t *mm);
 APR_DECLARE(apr_status_t) apr_mmap_offset(void **addr, apr_mmap_t *mm, 
                                           apr_off_t offset);
 
+/**
+ * Tell the system how a range of an mmap'ed file will be accessed, so
+ * that it can fault the pages in ahead of time or drop them.
+ * @param mm The mmap'ed file.
+ * @param offset The start of the range in the mmap.
+ * @param len The length of the range.
+ * @param advice One of the APR_FADVISE_* hints (@see apr_file_advise()).
+ * @remark This is only a hint, #APR_ENOTIMPL is returned on platforms
+ *         without madvise().
+ */
+APR_DECLARE(apr_status_t) apr_mmap_advise(apr_mmap_t *mm, apr_off_t offset,
+                                          apr_size_t len, int advice);
+
 #endif /* APR_HAS_MMAP */
 
 /** @} */
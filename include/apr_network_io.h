@@ -648,6 +648,43 @@ APR_DECLARE(apr_status_t) apr_socket_sendfile(apr_socket_t *sock,
 
 #endif /* APR_HAS_SENDFILE */
 
+/**
+ * Send data from a pipe to a socket without copying it through user
+ * space (splice() on Linux)
+ * @param sock The socket to which we're writing
+ * @param pipe The pipe from which to read, as created by
+ *             apr_file_pipe_create_ex() (or another pipe descriptor)
+ * @param len (input)  - Maximum number of bytes to send
+ *            (output) - Number of bytes actually sent
+ * @return APR_SUCCESS, APR_EOF when the pipe is empty and has no writers
+ *         anymore, APR_EAGAIN when the pipe is empty or the socket would
+ *         block, APR_ENOTIMPL if the platform has no such thing or if the
+ *         pipe is buffered (APR_FOPEN_BUFFERED) or had a character pushed
+ *         back (apr_file_ungetc()), or an error code.
+ * @remark This function acts like a blocking write by default, but it
+ *         does not wait for data in the pipe (@see apr_file_pipe_wait()).
+ */
+APR_DECLARE(apr_status_t) apr_socket_send_pipe(apr_socket_t *sock,
+                                               apr_file_t *pipe,
+                                               apr_size_t *len);
+
+/**
+ * Receive data from a socket into a pipe without copying it through user
+ * space (splice() on Linux)
+ * @param sock The socket from which to read
+ * @param pipe The pipe to which we're writing
+ * @param len (input)  - Maximum number of bytes to receive
+ *            (output) - Number of bytes actually received
+ * @return APR_SUCCESS, APR_EOF when the peer closed the connection,
+ *         APR_EAGAIN when the pipe is full or the socket would block,
+ *         APR_ENOTIMPL if the platform has no such thing, or an error code.
+ * @remark This function acts like a blocking read by default, but it
+ *         does not wait for room in the pipe.
+ */
+APR_DECLARE(apr_status_t) apr_socket_recv_pipe(apr_socket_t *sock,
+                                               apr_file_t *pipe,
+                                               apr_size_t *len);
+
 /**
  * Read data from a network.
  * @param sock The socket to read the data from.
@@ -388,6 +388,40 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *p,
     apr_pool_destroy_debug(p, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Destroy the pool asynchronously, on a background (reaper) thread
+ * @param p The pool to destroy
+ * @remark The pool is detached from its parent right away and must not be
+ *         used anymore by the caller, while its cleanups run and its
+ *         memory is freed later on by the reaper thread.  Any cleanup of
+ *         the pool or its subpools must thus be fine to run from another
+ *         thread, and must not depend on pools which may be destroyed
+ *         in the meantime (but the owner of the allocator, whose
+ *         destruction waits for the deferred pools using it).
+ * @remark The pool is destroyed inline, as with apr_pool_destroy(), when
+ *         the reaper can't be used: without threads, with APR_POOL_DEBUG,
+ *         if the allocator of the pool is not thread safe (has no mutex)
+ *         while not owned by the pool itself, if the reaper thread can't
+ *         be started, or if too many pools are already waiting for it
+ *         (@see apr_pool_reaper_max_set()), such that the callers pay the
+ *         teardowns when it falls behind.
+ * @remark apr_pool_terminate() waits for all the deferred pools to be
+ *         destroyed.
+ */
+APR_DECLARE(void) apr_pool_destroy_deferred(apr_pool_t *p)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Set the maximum number of pools waiting to be destroyed by the reaper
+ * thread, beyond which apr_pool_destroy_deferred() destroys inline
+ * @param max The maximum, 0 to always destroy inline (the default is
+ *        APR_POOL_REAPER_MAX_DEFAULT)
+ */
+APR_DECLARE(void) apr_pool_reaper_max_set(apr_size_t max);
+
+/** The default maximum number of pools waiting for the reaper thread */
+#define APR_POOL_REAPER_MAX_DEFAULT 1024
+
 
 /*
  * Memory allocation
@@ -454,6 +488,123 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *p, apr_size_t size,
     apr_pcalloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Allocate an aligned block of memory from a pool
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment of the block, a power of two (e.g. 32 or
+ *        64 for SIMD vectors or cache lines, apr_allocator_page_size())
+ * @return The allocated memory, or NULL if @a alignment is not a power of
+ *         two or the allocation failed
+ * @remark The block is carved from the active node of the pool when it
+ *         has room enough once aligned, so the padding is at most
+ *         @a alignment minus the default alignment of apr_palloc().
+ */
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *p, apr_size_t size,
+                                       apr_size_t alignment)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(2)))
+#endif
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate an aligned block of memory from a pool and set all of the
+ * memory to 0
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment of the block, a power of two
+ * @return The allocated memory, or NULL (@see apr_palloc_aligned())
+ */
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *p, apr_size_t size,
+                                        apr_size_t alignment)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(2)))
+#endif
+                    __attribute__((nonnull(1)));
+
+/**
+ * Grow a block of memory allocated from a pool
+ * @param p The pool the block was allocated from
+ * @param mem The block to grow, or NULL to allocate a new one
+ * @param old_size The size the block was allocated with
+ * @param new_size The size needed
+ * @return The grown block, which is @a mem itself when it was the last
+ *         block allocated from @a p and there is room enough after it,
+ *         otherwise a new block (of @a new_size) with the @a old_size
+ *         bytes of @a mem copied, or NULL if the allocation failed (@a mem
+ *         being left as is).
+ * @remark When the block is moved, it is left as is (still valid) and
+ *         its memory is lost until the pool is cleared, as with
+ *         apr_palloc() and copy.
+ * @remark The added memory is not initialized, and @a mem is returned
+ *         unchanged if @a new_size is not greater than @a old_size.
+ * @remark @a old_size must be the size @a mem was allocated with.  A
+ *         block shared with others (e.g. with apr_array_copy_hdr()) can be
+ *         given, they only see it grow in place past their own size.
+ */
+APR_DECLARE(void *) apr_palloc_grow(apr_pool_t *p, void *mem,
+                                    apr_size_t old_size, apr_size_t new_size)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(4)))
+#endif
+                    __attribute__((nonnull(1)));
+
+/**
+ * A point in the life of a pool to release it back to,
+ * @see apr_pool_mark()
+ * @remark The fields are private to the pools implementation, the
+ *         structure is only public so that marks can live on the stack.
+ */
+typedef struct apr_pool_mark_t apr_pool_mark_t;
+
+struct apr_pool_mark_t {
+    /** The enclosing mark */
+    apr_pool_mark_t *prev;
+    /** The memory state at the time of the mark */
+    void *node;
+    char *first_avail;
+    void *nodes;
+    apr_size_t index;
+    apr_size_t alloc;
+    /** Where the (pre-)cleanups registered after the mark stop */
+    void *cleanup;
+    void *pre_cleanup;
+    /** The subprocesses and user data at the time of the mark */
+    void *subprocesses;
+    void *user_data;
+};
+
+/**
+ * Mark the current state of a pool, to release later everything
+ * allocated from it since then
+ * @param p The pool to mark
+ * @param mark The mark to initialize
+ * @remark Marks can be nested, and must be released in the reverse order
+ *         they were taken.  Releasing a mark releases the inner marks not
+ *         released yet, and clearing or destroying the pool invalidates
+ *         all of its marks (which need not be released then).
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Release a pool to a mark, freeing the memory allocated from it since
+ * @a mark was taken and running the cleanups registered since then
+ * @param p The pool @a mark was taken from
+ * @param mark The mark to release the pool to
+ * @remark The memory allocated after the mark must not be used anymore,
+ *         while the memory allocated before is kept.  The memory blocks
+ *         allocated after the mark are given back to the allocator.
+ * @remark As with apr_pool_clear(), the pre-cleanups registered since
+ *         the mark are run first, then the cleanups (in the LIFO order),
+ *         and the subprocesses noted since then are disposed of.  The user
+ *         data is restored as it was when the mark was taken.  Subpools
+ *         are not affected.
+ */
+APR_DECLARE(void) apr_pool_release_to_mark(apr_pool_t *p,
+                                           apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * Pool Properties
@@ -516,6 +667,68 @@ APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
 APR_DECLARE(const char *) apr_pool_get_tag(apr_pool_t *pool)
                   __attribute__((nonnull(1)));
 
+/*
+ * Pool Statistics
+ */
+
+/**
+ * Memory usage statistics of a pool, @see apr_pool_stats_get()
+ */
+typedef struct apr_pool_stats_t {
+    /** The pool's tag, or NULL if none */
+    const char *tag;
+    /** Number of memory nodes held by the pool */
+    apr_size_t nodes;
+    /** Total size of the nodes, including their headers */
+    apr_size_t bytes_total;
+    /** Bytes allocated from the pool (including the pool structure and
+     * the alignment padding) */
+    apr_size_t bytes_alloc;
+    /** Bytes left free at the tail of the nodes but the active one, which
+     * likely won't be used anymore */
+    apr_size_t bytes_wasted;
+    /** The highest bytes_alloc seen since the pool was created, updated
+     * when the pool gets a new node, is cleared or released to a mark */
+    apr_size_t bytes_peak;
+} apr_pool_stats_t;
+
+/**
+ * Get the memory usage statistics of a pool (not its subpools)
+ * @param pool The pool
+ * @param stats The statistics to fill in
+ * @remark This is available regardless of APR_POOL_DEBUG, and costs
+ *         little until called (a walk over the nodes of the pool).
+ * @remark The pool must not be used concurrently.
+ */
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool, apr_pool_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Callback for apr_pool_stats_walk()
+ * @param pool The pool the statistics are about
+ * @param stats The statistics of the pool
+ * @param depth The depth of the pool below the one the walk started from
+ * @param data The data passed to apr_pool_stats_walk()
+ * @return Zero to continue the walk, non-zero to stop it
+ */
+typedef int (apr_pool_stats_fn_t)(apr_pool_t *pool,
+                                  const apr_pool_stats_t *stats,
+                                  int depth, void *data);
+
+/**
+ * Walk a pool and its subpools (depth first), calling a function with
+ * the statistics of each
+ * @param pool The pool to start from
+ * @param fn The function to call for each pool
+ * @param data The data to pass to @a fn
+ * @return The non-zero value returned by @a fn to stop the walk, or zero
+ * @remark Pools of the tree must not be created, destroyed or used
+ *         concurrently.
+ */
+APR_DECLARE(int) apr_pool_stats_walk(apr_pool_t *pool, apr_pool_stats_fn_t *fn,
+                                     void *data)
+                 __attribute__((nonnull(1,2)));
+
 /*
  * User data management
  */
@@ -676,6 +889,57 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
                                                apr_status_t (*cleanup)(void *))
                           __attribute__((nonnull(3)));
 
+/** Opaque handle of a registered cleanup,
+ *  @see apr_pool_cleanup_register_handle() */
+typedef struct apr_pool_cleanup_t apr_pool_cleanup_t;
+
+/**
+ * Register a function to be called when a pool is cleared or destroyed,
+ * returning a handle to unregister it in constant time
+ * @param p The pool to register the cleanup with
+ * @param data The data to pass to the cleanup function.
+ * @param plain_cleanup The function to call when the pool is cleared
+ *                      or destroyed
+ * @param child_cleanup The function to call when a child process is about
+ *                      to exec - this function is called in the child, obviously!
+ * @return The handle of the cleanup, for apr_pool_cleanup_kill_handle()
+ *         or apr_pool_cleanup_run_handle().
+ * @remark Same as apr_pool_cleanup_register() otherwise, the cleanup can
+ *         be killed by apr_pool_cleanup_kill() too.
+ */
+APR_DECLARE(apr_pool_cleanup_t *) apr_pool_cleanup_register_handle(
+                            apr_pool_t *p, const void *data,
+                            apr_status_t (*plain_cleanup)(void *),
+                            apr_status_t (*child_cleanup)(void *))
+                                  __attribute__((nonnull(3,4)));
+
+/**
+ * Remove a cleanup registered with apr_pool_cleanup_register_handle()
+ * @param p The pool the cleanup was registered with
+ * @param cleanup The handle of the cleanup
+ * @remark Unlike apr_pool_cleanup_kill(), this does not search the cleanups
+ *         of the pool, which matters for pools with many of them.
+ * @remark Nothing is done if the cleanup is running (or has run) already,
+ *         but the handle must not be used once the cleanup has been killed
+ *         since it is recycled by the next registrations.
+ */
+APR_DECLARE(void) apr_pool_cleanup_kill_handle(apr_pool_t *p,
+                                               apr_pool_cleanup_t *cleanup)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Run a cleanup registered with apr_pool_cleanup_register_handle()
+ * immediately and unregister it
+ * @param p The pool the cleanup was registered with
+ * @param cleanup The handle of the cleanup
+ * @return The value returned by the cleanup function
+ * @remark The same restrictions as for apr_pool_cleanup_kill_handle()
+ *         apply.
+ */
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_handle(apr_pool_t *p,
+                                               apr_pool_cleanup_t *cleanup)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * An empty cleanup function.
  * 
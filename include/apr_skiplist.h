@@ -69,9 +69,9 @@ typedef struct apr_skiplistnode apr_skiplistnode;
  * @param sl The skip list
  * @param size The amount to allocate
  * @remark If a pool was provided to apr_skiplist_init(), memory will
- * be allocated from the pool or from a free list maintained with
- * the skip list.  Otherwise, memory will be allocated using the
- * C standard library heap functions.
+ * be allocated from object caches (one per size, @see apr_slab.h)
+ * maintained with the skip list.  Otherwise, memory will be allocated
+ * using the C standard library heap functions.
  */
 APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size);
 
@@ -80,8 +80,11 @@ APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size);
  * @param sl The skip list
  * @param mem The object to free
  * @remark If a pool was provided to apr_skiplist_init(), memory will
- * be added to a free list maintained with the skip list and be available
- * to operations on the skip list or to other calls to apr_skiplist_alloc().
+ * be given back (in O(1)) to the object cache maintained with the skip
+ * list and be available to operations on the skip list or to other calls
+ * to apr_skiplist_alloc().  Memory not allocated by apr_skiplist_alloc()
+ * from the pool (but still readable before @a mem), or freed already, is
+ * ignored then.
  * Otherwise, memory will be freed using the  C standard library heap
  * functions.
  */
@@ -0,0 +1,147 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SLAB_H
+#define APR_SLAB_H
+
+/**
+ * @file apr_slab.h
+ * @brief APR fixed size object cache
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_slab Fixed size object cache
+ * @ingroup APR
+ * Objects of the same size, allocated from and freed to a cache one
+ * by one in O(1).  The memory is carved out of memnodes of the pool's
+ * allocator (the slabs), which go back to the allocator when the cache
+ * is destroyed.
+ * @{
+ */
+
+/** Opaque object cache */
+typedef struct apr_slab_t apr_slab_t;
+
+/**
+ * @defgroup apr_slab_flags Object cache flags
+ * @{
+ */
+/** The cache can be used by multiple threads at once */
+#define APR_SLAB_THREADSAFE 0x01
+/** Each thread has its own magazine of free objects, refilled and emptied
+ *  by batches, so that allocating and freeing objects do not take the
+ *  cache mutex in the steady state (implies APR_SLAB_THREADSAFE) */
+#define APR_SLAB_MAGAZINES  0x02
+/** @} */
+
+/**
+ * Statistics of an object cache, @see apr_slab_stats_get()
+ */
+typedef struct apr_slab_stats_t {
+    /** Size of the objects (aligned) */
+    apr_size_t size;
+    /** Number of slabs taken from the allocator */
+    apr_size_t slabs;
+    /** Total size of the slabs */
+    apr_size_t bytes;
+    /** Number of objects carved out of the slabs so far */
+    apr_size_t objects;
+    /** Number of objects in use */
+    apr_size_t inuse;
+    /** Number of free objects in the cache */
+    apr_size_t free;
+    /** Number of free objects in the magazines of the threads */
+    apr_size_t cached;
+} apr_slab_stats_t;
+
+/**
+ * Create an object cache
+ * @param slab The new object cache
+ * @param size The size of the objects
+ * @param flags APR_SLAB_* flags, or 0
+ * @param pool The pool to allocate the cache from, and whose allocator
+ *        provides the slabs.  When it is cleared or destroyed, the slabs
+ *        are given back to the allocator.
+ * @return APR_SUCCESS, APR_EINVAL if @a size is 0, APR_ENOTIMPL for
+ *         thread safe caches without threads, or the error of creating
+ *         the mutex or thread key.
+ * @remark When the cache is used by multiple threads, the allocator of
+ *         @a pool must be thread safe too (@see apr_allocator_mutex_set()).
+ */
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **slab, apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Allocate an object from a cache
+ * @param slab The object cache
+ * @return The object, or NULL if memory is exhausted (the abort function
+ *         of the pool, if any, is called first).
+ */
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate an object from a cache and set all of its memory to 0
+ * @param slab The object cache
+ * @return The object, or NULL if memory is exhausted.
+ */
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Give an object back to its cache
+ * @param slab The object cache the object was allocated from
+ * @param mem The object to free, or NULL
+ */
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *mem)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get the statistics of an object cache
+ * @param slab The object cache
+ * @param stats The statistics
+ * @remark The result is a snapshot, the magazines of the threads being
+ *         counted while they may still be in use.
+ */
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab, apr_slab_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Destroy an object cache before its pool, giving all the slabs back
+ * @param slab The object cache
+ * @remark All the objects of the cache are invalid afterwards, and no
+ *         other thread may use it anymore.
+ */
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+                  __attribute__((nonnull(1)));
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_SLAB_H */
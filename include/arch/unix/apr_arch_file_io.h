@@ -148,6 +148,8 @@ struct apr_file_t {
 #define lstat(f,b) lstat64(f,b)
 #define fstat(f,b) fstat64(f,b)
 #define lseek(f,o,w) lseek64(f,o,w)
+#define pread(f,b,n,o) pread64(f,b,n,o)
+#define posix_fadvise(f,o,l,a) posix_fadvise64(f,o,l,a)
 #define ftruncate(f,l) ftruncate64(f,l)
 typedef struct stat64 struct_stat;
 #else
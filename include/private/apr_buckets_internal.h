@@ -0,0 +1,60 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_BUCKETS_INTERNAL_H
+#define APR_BUCKETS_INTERNAL_H
+
+#include "apr_buckets.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The size of the reads of the pipe and socket buckets adapts to the
+ * traffic: it doubles when a read fills the buffer, up to the maximum, and
+ * halves when a read does not fill half of it, down to APR_BUCKET_BUFF_SIZE
+ * (the allocator would not give less anyway).  It is kept per stream (the
+ * pipe or socket) in the stream's pool, since each read makes a new bucket.
+ */
+typedef struct apr_bucket_read_size_t {
+    const void *stream;
+    apr_size_t size;
+    apr_size_t max;
+} apr_bucket_read_size_t;
+
+/* The read size state of the stream, or NULL if none and !create */
+apr_bucket_read_size_t *apr_bucket_read_size_get(apr_pool_t *pool,
+                                                 const void *stream,
+                                                 int create);
+
+/* The size of the next read of the stream (from an allocator) */
+apr_size_t apr_bucket_read_size_next(apr_bucket_alloc_t *list,
+                                     const apr_bucket_read_size_t *rs);
+
+/* Adapt to a read of len bytes out of size (rs may be NULL) */
+void apr_bucket_read_size_adapt(apr_pool_t *pool, const void *stream,
+                                apr_bucket_read_size_t *rs,
+                                apr_size_t size, apr_size_t len);
+
+/* Set the maximum read size of the stream, 0 for the default */
+void apr_bucket_read_size_max_set(apr_pool_t *pool, const void *stream,
+                                  apr_size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_BUCKETS_INTERNAL_H */
@@ -227,6 +227,10 @@ SOURCE=.\buckets\apr_buckets_refcount.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\buckets\apr_buckets_shm.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\buckets\apr_buckets_simple.c
 # End Source File
 # Begin Source File
@@ -464,6 +468,10 @@ SOURCE=.\memcache\apr_memcache.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -695,6 +703,10 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # Begin Source File
 
@@ -924,6 +936,10 @@ SOURCE=.\include\apr_atomic.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_dso.h
 # End Source File
 # Begin Source File
@@ -1067,6 +1083,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -25,6 +25,7 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
@@ -44,10 +45,24 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+/* Huge page backed arenas, @see apr_allocator_create_ex() */
+#if !APR_ALLOCATOR_GUARD_PAGES && defined(HAVE_MMAP) && defined(HAVE_MAP_ANON)
+#define ALLOCATOR_USES_ARENAS     1
+#endif
+
+/* Trimming of idle free nodes, @see apr_allocator_trim_set() */
+#if defined(HAVE_MADVISE) && defined(HAVE_SYS_MMAN_H)
+#define ALLOCATOR_USES_TRIM       1
+#endif
+
+#if APR_ALLOCATOR_USES_MMAP || ALLOCATOR_USES_ARENAS || ALLOCATOR_USES_TRIM
 #include <sys/mman.h>
 #endif
 
+#if ALLOCATOR_USES_TRIM && !defined(MADV_DONTNEED)
+#undef ALLOCATOR_USES_TRIM
+#endif
+
 #if HAVE_VALGRIND
 #define REDZONE APR_ALIGN_DEFAULT(8)
 int apr_running_on_valgrind = 0;
@@ -105,6 +120,24 @@ static unsigned int boundary_size;
 #define TIMEOUT_USECS    3000000
 #define TIMEOUT_INTERVAL   46875
 
+/*
+ * Size (and alignment) of the arenas which APR_ALLOCATOR_HUGEPAGES
+ * allocators carve their nodes from, that's the usual huge page size.
+ */
+#define ARENA_SIZE  (2 * 1024 * 1024)
+
+#if APR_HAS_THREADS
+typedef struct allocator_tcache_t allocator_tcache_t;
+#endif
+#if ALLOCATOR_USES_ARENAS
+typedef struct allocator_arena_t allocator_arena_t;
+
+struct allocator_arena_t {
+    allocator_arena_t *next;
+    char              *base;
+};
+#endif
+
 /*
  * Allocator
  *
@@ -142,10 +175,78 @@ struct apr_allocator_t {
      * slot 20: nodes larger than 81920
      */
     apr_memnode_t      *free[MAX_INDEX + 1];
+    /** APR_ALLOCATOR_* creation flags */
+    apr_uint32_t        flags;
+    /** Number of nodes given back to the system because of max_free */
+    apr_size_t          max_free_hits;
+    /** Whether idle free nodes are trimmed, after trim_idle seconds,
+     * and when (in seconds) they were last.
+     * @see apr_allocator_trim_set()
+     */
+    int                 trim;
+    apr_uint32_t        trim_idle;
+    apr_uint32_t        trim_interval;
+    apr_uint32_t        trim_last;
+#if ALLOCATOR_USES_ARENAS
+    /** The arenas mapped so far, and the free space of the current one */
+    allocator_arena_t  *arenas;
+    char               *arena_avail;
+    char               *arena_endp;
+#endif
+#if APR_HAS_THREADS
+    /** Per-thread node caches, @see apr_allocator_thread_cache_set() */
+    apr_threadkey_t    *tcache_key;
+    apr_pool_t         *tcache_pool;
+    /** Maximum number of nodes cached per thread and per index */
+    apr_size_t          tcache_max;
+    /** List of all the live thread caches (under the allocator mutex) */
+    allocator_tcache_t *tcaches;
+    /** Hits/misses accumulated by the thread caches already gone */
+    apr_size_t          tcache_hits;
+    apr_size_t          tcache_misses;
+    /** Number of pools using the allocator (not owning it) waiting for
+     * the reaper thread, under the reaper mutex.
+     * @see apr_pool_destroy_deferred()
+     */
+    apr_size_t          deferred;
+#endif /* APR_HAS_THREADS */
 };
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+/* Aligns the given pointer up to a power of two (APR_ALIGN() would
+ * truncate it to 32 bits).
+ */
+#define ALIGN_PTR(ptr, boundary) \
+    ((char *)(((apr_uintptr_t)(ptr) + ((boundary) - 1)) \
+              & ~((apr_uintptr_t)(boundary) - 1)))
+
+#if MAX_INDEX + 1 != APR_ALLOCATOR_STATS_SLOTS
+#error APR_ALLOCATOR_STATS_SLOTS does not match MAX_INDEX
+#endif
+
+#if APR_HAS_THREADS
+/*
+ * Thread cache
+ *
+ * Each thread using an allocator with a thread cache gets its own small
+ * free lists for the slots 0..MAX_INDEX-1, which are filled/emptied in
+ * batches from/to the allocator's free lists.  The cache is only ever
+ * touched by its thread, so no locking is needed to use it; the
+ * allocator mutex protects the list of caches only.
+ */
+struct allocator_tcache_t {
+    allocator_tcache_t  *next;
+    allocator_tcache_t **ref;
+    apr_allocator_t     *allocator;
+    /** Statistics, read (unlocked) by apr_allocator_thread_cache_stats() */
+    apr_size_t           hits;
+    apr_size_t           misses;
+    apr_size_t           count[MAX_INDEX];
+    apr_memnode_t       *free[MAX_INDEX];
+};
+#endif /* APR_HAS_THREADS */
+
 
 /*
  * Allocator
@@ -169,32 +270,69 @@ void allocator_unlock(apr_allocator_t *allocator)
 #endif /* APR_HAS_THREADS */
 }
 
-APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
+#if APR_HAS_THREADS
+static apr_status_t allocator_tcache_cleanup(void *data);
+#endif /* APR_HAS_THREADS */
+static APR_INLINE
+void allocator_free_nodes(apr_allocator_t *allocator, apr_memnode_t *node);
+
+/* Whether a node of the given index is (or would be) carved from an arena,
+ * hence can't be given back to the system on its own.
+ */
+#if ALLOCATOR_USES_ARENAS
+#define node_in_arena(allocator, index) \
+    (((allocator)->flags & APR_ALLOCATOR_HUGEPAGES) && (index) < MAX_INDEX)
+#else
+#define node_in_arena(allocator, index) 0
+#endif
+
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
 {
     apr_allocator_t *new_allocator;
 
     *allocator = NULL;
 
+#if !ALLOCATOR_USES_ARENAS
+    if (flags & APR_ALLOCATOR_HUGEPAGES)
+        return APR_ENOTIMPL;
+#endif
+
     if ((new_allocator = malloc(SIZEOF_ALLOCATOR_T)) == NULL)
         return APR_ENOMEM;
 
     memset(new_allocator, 0, SIZEOF_ALLOCATOR_T);
     new_allocator->max_free_index = APR_ALLOCATOR_MAX_FREE_UNLIMITED;
+    new_allocator->flags = flags;
 
     *allocator = new_allocator;
 
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
+{
+    return apr_allocator_create_ex(allocator, 0);
+}
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_size_t index;
     apr_memnode_t *node, **ref;
 
+#if APR_HAS_THREADS
+    if (allocator->tcache_key) {
+        apr_pool_cleanup_run(allocator->tcache_pool, allocator,
+                             allocator_tcache_cleanup);
+    }
+#endif /* APR_HAS_THREADS */
+
     for (index = 0; index <= MAX_INDEX; index++) {
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
             *ref = node->next;
+            if (node_in_arena(allocator, node->index))
+                continue;
 #if APR_ALLOCATOR_USES_MMAP
             munmap((char *)node - GUARDPAGE_SIZE,
                    2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
@@ -204,6 +342,16 @@ APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
         }
     }
 
+#if ALLOCATOR_USES_ARENAS
+    while (allocator->arenas) {
+        allocator_arena_t *arena = allocator->arenas;
+
+        allocator->arenas = arena->next;
+        munmap(arena->base, ARENA_SIZE);
+        free(arena);
+    }
+#endif
+
     free(allocator);
 }
 
@@ -250,6 +398,515 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
     allocator_unlock(allocator);
 }
 
+#if ALLOCATOR_USES_ARENAS
+
+/* Map an arena, using explicit huge pages if some are available, or else
+ * hinting the system to back it with transparent huge pages.
+ */
+static char *allocator_arena_map(void)
+{
+    char *mem, *base;
+    apr_size_t head;
+
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, ARENA_SIZE, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+        return mem;
+#endif
+
+    /* Over-map to align the arena on a huge page boundary, and trim */
+    mem = mmap(NULL, 2 * ARENA_SIZE, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    base = ALIGN_PTR(mem, ARENA_SIZE);
+    head = base - mem;
+    if (head)
+        munmap(mem, head);
+    munmap(base + ARENA_SIZE, ARENA_SIZE - head);
+
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+    (void)madvise(base, ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+
+    return base;
+}
+
+/* Carve a node of the given (aligned) size from the current arena, or from
+ * a new one if it's exhausted.  Must be called with the allocator locked.
+ */
+static apr_memnode_t *allocator_arena_alloc(apr_allocator_t *allocator,
+                                            apr_size_t size)
+{
+    allocator_arena_t *arena;
+    apr_memnode_t *node;
+    apr_size_t index;
+    char *base;
+
+    if ((apr_size_t)(allocator->arena_endp - allocator->arena_avail) < size) {
+        /* Recycle the tail of the current arena as a free node, it is
+         * smaller than the requested size so it fits in a slot.
+         */
+        if (allocator->arena_avail != allocator->arena_endp) {
+            node = (apr_memnode_t *)allocator->arena_avail;
+            index = ((allocator->arena_endp - allocator->arena_avail)
+                     >> BOUNDARY_INDEX) - 1;
+            node->index = (apr_uint32_t)index;
+            node->endp = allocator->arena_endp;
+            if ((node->next = allocator->free[index]) == NULL
+                && index > allocator->max_index) {
+                allocator->max_index = index;
+            }
+            allocator->free[index] = node;
+            allocator->arena_avail = allocator->arena_endp;
+        }
+
+        if ((arena = malloc(sizeof(allocator_arena_t))) == NULL)
+            return NULL;
+        if ((base = allocator_arena_map()) == NULL) {
+            free(arena);
+            return NULL;
+        }
+        arena->base = base;
+        arena->next = allocator->arenas;
+        allocator->arenas = arena;
+        allocator->arena_avail = base;
+        allocator->arena_endp = base + ARENA_SIZE;
+    }
+
+    node = (apr_memnode_t *)allocator->arena_avail;
+    allocator->arena_avail += size;
+
+    return node;
+}
+
+#endif /* ALLOCATOR_USES_ARENAS */
+
+/*
+ * Trimming
+ *
+ * While on the free lists of an allocator which trims, the free_index
+ * field of a node holds the time (in seconds) it was given back, and its
+ * first_avail field is set to NULL once its pages have been trimmed.  Both
+ * are reset when the node is allocated again.
+ */
+
+static APR_INLINE
+apr_uint32_t allocator_trim_clock(void)
+{
+    return (apr_uint32_t)apr_time_sec(apr_time_now());
+}
+
+static APR_INLINE
+void node_trim_stamp(apr_memnode_t *node, apr_uint32_t now)
+{
+    node->free_index = now;
+}
+
+#if ALLOCATOR_USES_TRIM
+/* MADV_FREE is cheaper (the pages are reclaimed lazily, only under memory
+ * pressure), but not supported by all the kernels which define it.
+ */
+static APR_INLINE
+int allocator_trim_pages(char *begin, apr_size_t len)
+{
+#ifdef MADV_FREE
+    if (madvise(begin, len, MADV_FREE) == 0)
+        return 0;
+#endif
+    return madvise(begin, len, MADV_DONTNEED);
+}
+#endif
+
+#define node_is_trimmed(allocator, node) \
+    ((node)->first_avail == NULL && !node_in_arena(allocator, (node)->index))
+
+/* Trim the nodes idle for long enough, the allocator must be locked since
+ * the nodes stay on the free lists (in place).
+ */
+static apr_size_t allocator_trim_nodes(apr_allocator_t *allocator,
+                                       apr_uint32_t now)
+{
+    apr_size_t trimmed = 0;
+#if ALLOCATOR_USES_TRIM
+    apr_memnode_t *node;
+    apr_size_t index;
+    char *begin, *end;
+
+    allocator->trim_last = now;
+
+    for (index = 0; index <= MAX_INDEX; index++) {
+        for (node = allocator->free[index]; node; node = node->next) {
+            /* The nodes of an arena are much smaller than its huge pages,
+             * trimming them would fail (MAP_HUGETLB) or split the pages
+             * (transparent huge pages), which defeats the arenas.
+             */
+            if (node_in_arena(allocator, node->index)
+                || node->first_avail == NULL
+                || now - node->free_index < allocator->trim_idle) {
+                continue;
+            }
+
+            /* Keep the page holding the node header */
+            begin = (char *)(((apr_uintptr_t)node + APR_MEMNODE_T_SIZE
+                              + BOUNDARY_SIZE - 1)
+                             & ~((apr_uintptr_t)BOUNDARY_SIZE - 1));
+            end = (char *)((apr_uintptr_t)node->endp
+                           & ~((apr_uintptr_t)BOUNDARY_SIZE - 1));
+            if (begin < end
+                && allocator_trim_pages(begin, end - begin) == 0) {
+                trimmed += end - begin;
+            }
+            node->first_avail = NULL;
+        }
+    }
+#endif /* ALLOCATOR_USES_TRIM */
+
+    return trimmed;
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_trim_set(apr_allocator_t *allocator,
+                                                 apr_interval_time_t max_idle)
+{
+#if ALLOCATOR_USES_TRIM
+    apr_memnode_t *node;
+    apr_size_t index;
+    apr_uint32_t now;
+
+    now = allocator_trim_clock();
+
+    allocator_lock(allocator);
+
+    if (max_idle < 0) {
+        allocator->trim = 0;
+    }
+    else {
+        /* Nodes freed before are considered idle from now on */
+        if (!allocator->trim) {
+            for (index = 0; index <= MAX_INDEX; index++) {
+                for (node = allocator->free[index]; node; node = node->next)
+                    node_trim_stamp(node, now);
+            }
+        }
+        allocator->trim = 1;
+        allocator->trim_idle = (apr_uint32_t)apr_time_sec(max_idle);
+        allocator->trim_interval = allocator->trim_idle / 2;
+        if (allocator->trim_interval == 0)
+            allocator->trim_interval = 1;
+        allocator->trim_last = now;
+    }
+
+    allocator_unlock(allocator);
+
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif /* ALLOCATOR_USES_TRIM */
+}
+
+APR_DECLARE(apr_size_t) apr_allocator_trim(apr_allocator_t *allocator)
+{
+    apr_size_t trimmed;
+    apr_uint32_t now;
+
+    if (!allocator->trim)
+        return 0;
+
+    now = allocator_trim_clock();
+
+    allocator_lock(allocator);
+    trimmed = allocator_trim_nodes(allocator, now);
+    allocator_unlock(allocator);
+
+    return trimmed;
+}
+
+#if APR_HAS_THREADS
+
+static APR_INLINE
+apr_size_t allocator_tcache_batch(apr_allocator_t *allocator)
+{
+    /* Move half of a full cache at once from/to the allocator */
+    return (allocator->tcache_max + 1) / 2;
+}
+
+static allocator_tcache_t *allocator_tcache_get(apr_allocator_t *allocator)
+{
+    allocator_tcache_t *cache;
+    void *data;
+
+    if (apr_threadkey_private_get(&data, allocator->tcache_key) != APR_SUCCESS)
+        return NULL;
+
+    if ((cache = data) == NULL) {
+        if ((cache = malloc(sizeof(allocator_tcache_t))) == NULL)
+            return NULL;
+
+        memset(cache, 0, sizeof(allocator_tcache_t));
+        cache->allocator = allocator;
+
+        if (apr_threadkey_private_set(cache,
+                                      allocator->tcache_key) != APR_SUCCESS) {
+            free(cache);
+            return NULL;
+        }
+
+        allocator_lock(allocator);
+        if ((cache->next = allocator->tcaches) != NULL)
+            cache->next->ref = &cache->next;
+        allocator->tcaches = cache;
+        cache->ref = &allocator->tcaches;
+        allocator_unlock(allocator);
+    }
+
+    return cache;
+}
+
+/* Empty the given cache, prepending its nodes to freelist.  Must be called
+ * with the allocator locked, since the statistics are updated.
+ */
+static apr_memnode_t *allocator_tcache_drain(apr_allocator_t *allocator,
+                                             allocator_tcache_t *cache,
+                                             apr_memnode_t *freelist)
+{
+    apr_memnode_t *node;
+    apr_size_t index;
+
+    for (index = 0; index < MAX_INDEX; index++) {
+        while ((node = cache->free[index]) != NULL) {
+            cache->free[index] = node->next;
+            node->next = freelist;
+            freelist = node;
+        }
+        cache->count[index] = 0;
+    }
+
+    allocator->tcache_hits += cache->hits;
+    allocator->tcache_misses += cache->misses;
+
+    return freelist;
+}
+
+/* Thread exit: give the cached nodes back to the allocator */
+static void allocator_tcache_destroy(void *data)
+{
+    allocator_tcache_t *cache = data;
+    apr_allocator_t *allocator = cache->allocator;
+    apr_memnode_t *freelist;
+
+    allocator_lock(allocator);
+    if ((*cache->ref = cache->next) != NULL)
+        cache->next->ref = cache->ref;
+    freelist = allocator_tcache_drain(allocator, cache, NULL);
+    allocator_unlock(allocator);
+
+    free(cache);
+
+    if (freelist)
+        allocator_free_nodes(allocator, freelist);
+}
+
+static apr_status_t allocator_tcache_cleanup(void *data)
+{
+    apr_allocator_t *allocator = data;
+    allocator_tcache_t *cache;
+    apr_memnode_t *freelist = NULL;
+
+    apr_threadkey_private_delete(allocator->tcache_key);
+    allocator->tcache_key = NULL;
+    allocator->tcache_pool = NULL;
+
+    allocator_lock(allocator);
+    while ((cache = allocator->tcaches) != NULL) {
+        allocator->tcaches = cache->next;
+        freelist = allocator_tcache_drain(allocator, cache, freelist);
+        free(cache);
+    }
+    allocator_unlock(allocator);
+
+    if (freelist)
+        allocator_free_nodes(allocator, freelist);
+
+    return APR_SUCCESS;
+}
+
+static APR_INLINE
+apr_memnode_t *allocator_tcache_alloc(apr_allocator_t *allocator,
+                                      apr_size_t index)
+{
+    allocator_tcache_t *cache;
+    apr_memnode_t *node, *list = NULL;
+    apr_size_t max_index, batch, n = 0;
+
+    if ((cache = allocator_tcache_get(allocator)) == NULL)
+        return NULL;
+
+    if ((node = cache->free[index]) != NULL) {
+        cache->free[index] = node->next;
+        cache->count[index]--;
+        cache->hits++;
+
+        return node;
+    }
+
+    cache->misses++;
+
+    /* Refill the cache from the allocator's exact size slot, the caller
+     * falls back to the usual (best fit) lookup if there is nothing here.
+     */
+    if (index > allocator->max_index)
+        return NULL;
+
+    batch = allocator_tcache_batch(allocator);
+
+    allocator_lock(allocator);
+
+    while (n < batch && (node = allocator->free[index]) != NULL) {
+        allocator->free[index] = node->next;
+        allocator->current_free_index += node->index + 1;
+        node->next = list;
+        list = node;
+        n++;
+    }
+    if (allocator->current_free_index > allocator->max_free_index)
+        allocator->current_free_index = allocator->max_free_index;
+
+    max_index = allocator->max_index;
+    if (n && index >= max_index) {
+        while (max_index && allocator->free[max_index] == NULL)
+            max_index--;
+        allocator->max_index = max_index;
+    }
+
+    allocator_unlock(allocator);
+
+    if ((node = list) != NULL) {
+        cache->free[index] = node->next;
+        cache->count[index] = n - 1;
+    }
+
+    return node;
+}
+
+/* Put the given nodes in the thread cache, returning those which should
+ * go to the allocator.
+ */
+static APR_INLINE
+apr_memnode_t *allocator_tcache_free(apr_allocator_t *allocator,
+                                     apr_memnode_t *node)
+{
+    allocator_tcache_t *cache;
+    apr_memnode_t *next, *spill, *freelist = NULL;
+    apr_size_t index, batch;
+
+    if ((cache = allocator_tcache_get(allocator)) == NULL)
+        return node;
+
+    batch = allocator_tcache_batch(allocator);
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index >= MAX_INDEX) {
+            node->next = freelist;
+            freelist = node;
+            continue;
+        }
+
+        /* Give a batch back to the allocator if this slot is full */
+        if (cache->count[index] >= allocator->tcache_max) {
+            apr_size_t n;
+
+            for (n = 0; n < batch && cache->free[index]; n++) {
+                spill = cache->free[index];
+                cache->free[index] = spill->next;
+                spill->next = freelist;
+                freelist = spill;
+            }
+            cache->count[index] -= n;
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = cache->free[index];
+        cache->free[index] = node;
+        cache->count[index]++;
+    } while ((node = next) != NULL);
+
+    return freelist;
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_size_t max_nodes,
+                                          apr_pool_t *pool)
+{
+    apr_threadkey_t *key;
+    apr_status_t rv;
+
+    if (allocator->tcache_key) {
+        apr_pool_cleanup_run(allocator->tcache_pool, allocator,
+                             allocator_tcache_cleanup);
+    }
+
+    if (max_nodes == 0)
+        return APR_SUCCESS;
+
+    rv = apr_threadkey_private_create(&key, allocator_tcache_destroy, pool);
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    allocator->tcache_max = max_nodes;
+    allocator->tcache_pool = pool;
+    allocator->tcache_key = key;
+
+    apr_pool_cleanup_register(pool, allocator, allocator_tcache_cleanup,
+                              apr_pool_cleanup_null);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_allocator_thread_cache_stats(apr_allocator_t *allocator,
+                                                   apr_size_t *hits,
+                                                   apr_size_t *misses)
+{
+    allocator_tcache_t *cache;
+
+    allocator_lock(allocator);
+
+    *hits = allocator->tcache_hits;
+    *misses = allocator->tcache_misses;
+    for (cache = allocator->tcaches; cache; cache = cache->next) {
+        *hits += cache->hits;
+        *misses += cache->misses;
+    }
+
+    allocator_unlock(allocator);
+}
+
+#else /* !APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_size_t max_nodes,
+                                          apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(void) apr_allocator_thread_cache_stats(apr_allocator_t *allocator,
+                                                   apr_size_t *hits,
+                                                   apr_size_t *misses)
+{
+    *hits = *misses = 0;
+}
+
+#endif /* APR_HAS_THREADS */
+
 static APR_INLINE
 apr_size_t allocator_align(apr_size_t in_size)
 {
@@ -300,6 +957,14 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+#if APR_HAS_THREADS
+    /* Try the thread cache first, if any */
+    if (allocator->tcache_key && index < MAX_INDEX) {
+        if ((node = allocator_tcache_alloc(allocator, index)) != NULL)
+            goto have_node;
+    }
+#endif /* APR_HAS_THREADS */
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
@@ -389,6 +1054,16 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if ALLOCATOR_USES_ARENAS
+    if (node_in_arena(allocator, index)) {
+        allocator_lock(allocator);
+        node = allocator_arena_alloc(allocator, size);
+        allocator_unlock(allocator);
+        if (node == NULL)
+            return NULL;
+    }
+    else
+#endif
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -420,11 +1095,15 @@ have_node:
 }
 
 static APR_INLINE
-void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+void allocator_free_nodes(apr_allocator_t *allocator, apr_memnode_t *node)
 {
     apr_memnode_t *next, *freelist = NULL;
     apr_size_t index, max_index;
     apr_size_t max_free_index, current_free_index;
+    apr_uint32_t now = 0;
+
+    if (allocator->trim)
+        now = allocator_trim_clock();
 
     allocator_lock(allocator);
 
@@ -443,11 +1122,18 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
                               (node->index+1) << BOUNDARY_INDEX);
 
         if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
+            && index + 1 > current_free_index
+            && !node_in_arena(allocator, index)) {
             node->next = freelist;
             freelist = node;
+            allocator->max_free_hits++;
+            continue;
         }
-        else if (index < MAX_INDEX) {
+
+        if (allocator->trim)
+            node_trim_stamp(node, now);
+
+        if (index < MAX_INDEX) {
             /* Add the node to the appropriate 'size' bucket.  Adjust
              * the max_index when appropriate.
              */
@@ -477,6 +1163,9 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
     allocator->max_index = max_index;
     allocator->current_free_index = current_free_index;
 
+    if (allocator->trim && now - allocator->trim_last >= allocator->trim_interval)
+        allocator_trim_nodes(allocator, now);
+
     allocator_unlock(allocator);
 
     while (freelist != NULL) {
@@ -491,12 +1180,52 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
     }
 }
 
+static APR_INLINE
+void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+#if APR_HAS_THREADS
+    /* Keep what fits in the thread cache, if any */
+    if (allocator->tcache_key) {
+        if ((node = allocator_tcache_free(allocator, node)) == NULL)
+            return;
+    }
+#endif /* APR_HAS_THREADS */
+
+    allocator_free_nodes(allocator, node);
+}
+
 APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
                                                  apr_size_t size)
 {
     return allocator_alloc(allocator, size);
 }
 
+APR_DECLARE(apr_memnode_t *) apr_allocator_alloc_aligned(
+                                                 apr_allocator_t *allocator,
+                                                 apr_size_t size,
+                                                 apr_size_t alignment)
+{
+    apr_memnode_t *node;
+    apr_size_t padding;
+
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        return NULL;
+
+    /* The first_avail of a node is always aligned by default, so at most
+     * that much less than the alignment is needed to align it further.
+     */
+    padding = 0;
+    if (alignment > APR_ALIGN_DEFAULT(1))
+        padding = alignment - APR_ALIGN_DEFAULT(1);
+    if (size + padding < size)
+        return NULL;
+
+    if ((node = allocator_alloc(allocator, size + padding)) != NULL)
+        node->first_avail = ALIGN_PTR(node->first_avail, alignment);
+
+    return node;
+}
+
 APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
                                      apr_memnode_t *node)
 {
@@ -517,6 +1246,29 @@ APR_DECLARE(apr_status_t) apr_allocator_min_order_set(unsigned int order)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+{
+    apr_memnode_t *node;
+    apr_size_t index;
+
+    memset(stats, 0, sizeof(*stats));
+
+    allocator_lock(allocator);
+
+    for (index = 0; index <= MAX_INDEX; index++) {
+        for (node = allocator->free[index]; node; node = node->next) {
+            stats->free_nodes[index]++;
+            stats->free_bytes += (node->index + 1) << BOUNDARY_INDEX;
+            if (node_is_trimmed(allocator, node))
+                stats->trimmed_bytes += (node->index + 1) << BOUNDARY_INDEX;
+        }
+    }
+    stats->max_free_hits = allocator->max_free_hits;
+
+    allocator_unlock(allocator);
+}
+
 
 /*
  * Debug level
@@ -536,7 +1288,7 @@ APR_DECLARE(apr_status_t) apr_allocator_min_order_set(unsigned int order)
  * Structures
  */
 
-typedef struct cleanup_t cleanup_t;
+typedef struct apr_pool_cleanup_t cleanup_t;
 
 /** A list of processes */
 struct process_chain {
@@ -581,11 +1333,19 @@ struct apr_pool_t {
     apr_abortfunc_t       abort_fn;
     apr_hash_t           *user_data;
     const char           *tag;
+    apr_pool_mark_t      *mark; /* The innermost mark, @see apr_pool_mark() */
 
 #if !APR_POOL_DEBUG
     apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    apr_size_t            stat_peak; /* @see apr_pool_stats_get() */
+    apr_size_t            stat_alloc; /* Bytes allocated but in active */
+    /* The nodes allocated since a mark and not active anymore (off the
+     * ring), and whether the active node was allocated since a mark.
+     */
+    apr_memnode_t        *mark_nodes;
+    int                   active_marked;
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -627,6 +1387,32 @@ static apr_pool_t  *global_pool = NULL;
 
 #if !APR_POOL_DEBUG
 static apr_allocator_t *global_allocator = NULL;
+
+#if APR_HAS_THREADS
+/* The reaper thread of apr_pool_destroy_deferred(), and the queue of the
+ * pools to destroy (linked by their sibling), under reaper_mutex.  The
+ * reaper pool is only used with the mutex held.
+ */
+static apr_pool_t         *reaper_pool = NULL;
+static apr_thread_mutex_t *reaper_mutex = NULL;
+static apr_thread_cond_t  *reaper_cond = NULL;
+static apr_thread_cond_t  *reaper_done_cond = NULL;
+static apr_thread_t       *reaper_thread = NULL;
+static apr_pool_t         *reaper_list = NULL;
+static apr_pool_t        **reaper_tail = &reaper_list;
+static apr_size_t          reaper_pending = 0;
+static int                 reaper_stop = 0;
+#if APR_HAS_FORK
+/* The reaper thread does not exist in a forked child */
+static pid_t               reaper_pid;
+#define reaper_running() (reaper_thread && reaper_pid == getpid())
+#else
+#define reaper_running() (reaper_thread != NULL)
+#endif
+
+static void pool_detach(apr_pool_t *pool);
+#endif /* APR_HAS_THREADS */
+static apr_size_t          reaper_max = APR_POOL_REAPER_MAX_DEFAULT;
 #endif /* !APR_POOL_DEBUG */
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
@@ -716,6 +1502,19 @@ APR_DECLARE(apr_status_t) apr_pool_initialize(void)
         }
 
         apr_allocator_mutex_set(global_allocator, mutex);
+
+        /* The reaper thread itself is started on first use */
+        if ((rv = apr_pool_create(&reaper_pool, global_pool)) != APR_SUCCESS
+            || (rv = apr_thread_mutex_create(&reaper_mutex,
+                                             APR_THREAD_MUTEX_DEFAULT,
+                                             reaper_pool)) != APR_SUCCESS
+            || (rv = apr_thread_cond_create(&reaper_cond,
+                                            reaper_pool)) != APR_SUCCESS
+            || (rv = apr_thread_cond_create(&reaper_done_cond,
+                                            reaper_pool)) != APR_SUCCESS) {
+            return rv;
+        }
+        apr_pool_tag(reaper_pool, "apr_pool_reaper");
     }
 #endif /* APR_HAS_THREADS */
 
@@ -732,10 +1531,37 @@ APR_DECLARE(void) apr_pool_terminate(void)
     if (--apr_pools_initialized)
         return;
 
+#if APR_HAS_THREADS
+    /* Let the reaper destroy the pending pools, and wait for it */
+    if (reaper_running()) {
+        apr_status_t rv;
+
+        apr_thread_mutex_lock(reaper_mutex);
+        reaper_stop = 1;
+        apr_thread_cond_signal(reaper_cond);
+        apr_thread_mutex_unlock(reaper_mutex);
+
+        apr_thread_join(&rv, reaper_thread);
+    }
+    else if (reaper_thread) {
+        /* Forked child, destroying the condition variables could wait
+         * forever for the (parent's) reaper thread, leak them instead.
+         */
+        pool_detach(reaper_pool);
+    }
+    reaper_thread = NULL;
+#endif /* APR_HAS_THREADS */
+
     apr_pool_destroy(global_pool); /* This will also destroy the mutex */
     global_pool = NULL;
 
     global_allocator = NULL;
+#if APR_HAS_THREADS
+    reaper_pool = NULL;
+    reaper_mutex = NULL;
+    reaper_cond = reaper_done_cond = NULL;
+    reaper_stop = 0;
+#endif /* APR_HAS_THREADS */
 }
 
 
@@ -757,6 +1583,10 @@ APR_DECLARE(void) apr_pool_terminate(void)
 /* Returns the amount of free space in the given node. */
 #define node_free_space(node_) ((apr_size_t)(node_->endp - node_->first_avail))
 
+/* Bytes allocated from the node, including its padding */
+#define node_used_space(node_) ((apr_size_t)(node_->first_avail - \
+                                             ((char *)node_ + APR_MEMNODE_T_SIZE)))
+
 /*
  * Helpers to mark pool as in-use/free. Used for finding thread-unsafe
  * concurrent accesses from different threads.
@@ -823,11 +1653,60 @@ static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
  * Memory allocation
  */
 
+/* Make the given node (not on the ring) the active one of the pool, the
+ * previous active node is kept on the ring sorted by free space, or
+ * put aside if it was allocated under a mark.
+ */
+static APR_INLINE void pool_node_activate(apr_pool_t *pool,
+                                          apr_memnode_t *node)
+{
+    apr_memnode_t *active = pool->active;
+    apr_size_t free_index;
+    int active_marked = pool->active_marked;
+
+    node->free_index = 0;
+
+    list_insert(node, active);
+
+    pool->active = node;
+    pool->active_marked = (pool->mark != NULL);
+
+    /* The usage only grows with new nodes, so this is where it peaks
+     * (or when it's about to shrink, @see pool_stats_peak_update()).
+     */
+    pool->stat_alloc += node_used_space(active);
+    if (pool->stat_peak < pool->stat_alloc + node_used_space(node))
+        pool->stat_peak = pool->stat_alloc + node_used_space(node);
+
+    if (active_marked) {
+        list_remove(active);
+        active->next = pool->mark_nodes;
+        pool->mark_nodes = active;
+        return;
+    }
+
+    free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
+                            BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
+
+    active->free_index = (apr_uint32_t)free_index;
+    node = active->next;
+    if (free_index >= node->free_index)
+        return;
+
+    do {
+        node = node->next;
+    }
+    while (free_index < node->free_index);
+
+    list_remove(active);
+    list_insert(active, node);
+}
+
 APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 {
     apr_memnode_t *active, *node;
     void *mem;
-    apr_size_t size, free_index;
+    apr_size_t size;
 
     pool_concurrency_set_used(pool);
     size = APR_ALIGN_DEFAULT(in_size);
@@ -851,9 +1730,11 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
         goto have_mem;
     }
 
+    /* Under a mark, the nodes allocated before must not change */
     node = active->next;
-    if (size <= node_free_space(node)) {
+    if (!pool->mark && size <= node_free_space(node)) {
         list_remove(node);
+        pool->stat_alloc -= node_used_space(node);
     }
     else {
         if ((node = allocator_alloc(pool->allocator, size)) == NULL) {
@@ -865,30 +1746,10 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
         }
     }
 
-    node->free_index = 0;
-
     mem = node->first_avail;
     node->first_avail += size;
 
-    list_insert(node, active);
-
-    pool->active = node;
-
-    free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
-                            BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
-
-    active->free_index = (apr_uint32_t)free_index;
-    node = active->next;
-    if (free_index >= node->free_index)
-        goto have_mem;
-
-    do {
-        node = node->next;
-    }
-    while (free_index < node->free_index);
-
-    list_remove(active);
-    list_insert(active, node);
+    pool_node_activate(pool, node);
 
 have_mem:
 #if HAVE_VALGRIND
@@ -928,6 +1789,236 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t in_size,
+                                       apr_size_t alignment)
+{
+    apr_memnode_t *active, *node;
+    apr_size_t size, padding, redzone = 0;
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        return NULL;
+    if (alignment <= APR_ALIGN_DEFAULT(1))
+        return apr_palloc(pool, in_size);
+
+    pool_concurrency_set_used(pool);
+    size = APR_ALIGN_DEFAULT(in_size);
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind)
+        redzone = REDZONE;
+#endif
+    /* The worst case padding, first_avail being aligned by default */
+    padding = alignment - APR_ALIGN_DEFAULT(1);
+    if (size < in_size || size + 2 * redzone + padding < size) {
+        pool_concurrency_set_idle(pool);
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    active = pool->active;
+
+    /* If the active node has enough bytes left once aligned, use it. */
+    mem = ALIGN_PTR(active->first_avail + redzone, alignment);
+    if (mem <= active->endp
+        && size + redzone <= (apr_size_t)(active->endp - mem)) {
+        active->first_avail = mem + size + redzone;
+        goto have_mem;
+    }
+
+    if ((node = allocator_alloc(pool->allocator,
+                                size + 2 * redzone + padding)) == NULL) {
+        pool_concurrency_set_idle(pool);
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+
+    mem = ALIGN_PTR(node->first_avail + redzone, alignment);
+    node->first_avail = mem + size + redzone;
+
+    pool_node_activate(pool, node);
+
+have_mem:
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind)
+        VALGRIND_MEMPOOL_ALLOC(pool, mem, in_size);
+#endif
+    pool_concurrency_set_idle(pool);
+    return mem;
+}
+
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment)
+{
+    void *mem;
+
+    if ((mem = apr_palloc_aligned(pool, size, alignment)) != NULL)
+        memset(mem, 0, size);
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_palloc_grow(apr_pool_t *pool, void *mem,
+                                    apr_size_t old_size, apr_size_t new_size)
+{
+    apr_memnode_t *active;
+    apr_size_t size;
+    void *new_mem;
+
+    if (mem == NULL)
+        return apr_palloc(pool, new_size);
+    if (new_size <= old_size)
+        return mem;
+
+#if HAVE_VALGRIND
+    /* The blocks are surrounded by redzones, don't bother */
+    if (!apr_running_on_valgrind)
+#endif
+    {
+        pool_concurrency_set_used(pool);
+        active = pool->active;
+
+        /* Is this the last block allocated from the active node (and
+         * since the innermost mark, if any)?
+         */
+        size = APR_ALIGN_DEFAULT(old_size);
+        if ((char *)mem + size == active->first_avail
+            && (char *)mem >= (char *)active + APR_MEMNODE_T_SIZE
+            && (!pool->mark || pool->mark->node != active
+                || (char *)mem >= pool->mark->first_avail)) {
+            size = APR_ALIGN_DEFAULT(new_size);
+            if (size >= new_size
+                && size <= (apr_size_t)(active->endp - (char *)mem)) {
+                active->first_avail = (char *)mem + size;
+                pool_concurrency_set_idle(pool);
+                return mem;
+            }
+        }
+        pool_concurrency_set_idle(pool);
+    }
+
+    /* The block is not given back to the node even if it's the last one,
+     * it may still be used (e.g. shared by apr_array_copy_hdr()).
+     */
+    if ((new_mem = apr_palloc(pool, new_size)) == NULL)
+        return NULL;
+    memcpy(new_mem, mem, old_size);
+
+    return new_mem;
+}
+
+/* Before the usage shrinks */
+static APR_INLINE void pool_stats_peak_update(apr_pool_t *pool)
+{
+    apr_size_t alloc = pool->stat_alloc + node_used_space(pool->active);
+
+    if (pool->stat_peak < alloc)
+        pool->stat_peak = alloc;
+}
+
+static void pool_mark_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    mark->node = pool->active;
+    mark->first_avail = pool->active->first_avail;
+    mark->nodes = pool->mark_nodes;
+    mark->index = (apr_size_t)pool->active_marked;
+    mark->alloc = pool->stat_alloc;
+}
+
+static void pool_release_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_memnode_t *node, *next, *freelist = NULL;
+    apr_memnode_t *mark_node = mark->node;
+    int aside = 0;
+
+    pool_stats_peak_update(pool);
+
+    /* Free the nodes put aside since the mark, but the one it was taken
+     * in which becomes active again.
+     */
+    for (node = pool->mark_nodes; node != mark->nodes; node = next) {
+        next = node->next;
+        if (node == mark_node) {
+            aside = 1;
+            continue;
+        }
+        node->next = freelist;
+        freelist = node;
+    }
+    pool->mark_nodes = mark->nodes;
+
+    if (pool->active != mark_node) {
+        apr_memnode_t *active = pool->active;
+
+        node = active->next;
+        list_remove(active);
+        active->next = freelist;
+        freelist = active;
+
+        /* Back in place of the active node, the ring order is kept */
+        if (node != mark_node) {
+            if (!aside)
+                list_remove(mark_node);
+            list_insert(mark_node, node);
+        }
+        pool->active = mark_node;
+    }
+    pool->active_marked = (int)mark->index;
+    pool->stat_alloc = mark->alloc;
+
+    mark_node->first_avail = mark->first_avail;
+    APR_VALGRIND_NOACCESS(mark_node->first_avail,
+                          mark_node->endp - mark_node->first_avail);
+
+    if (freelist)
+        allocator_free(pool->allocator, freelist);
+}
+
+
+/*
+ * Pool statistics
+ */
+
+static void pool_stats(apr_pool_t *pool, apr_pool_stats_t *stats)
+{
+    apr_memnode_t *node;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->tag = pool->tag;
+
+    node = pool->active;
+    do {
+        stats->nodes++;
+        stats->bytes_total += node->endp - (char *)node;
+        stats->bytes_alloc += node->first_avail
+                              - ((char *)node + APR_MEMNODE_T_SIZE);
+        if (node != pool->active)
+            stats->bytes_wasted += node_free_space(node);
+
+        node = node->next;
+    } while (node != pool->active);
+
+    for (node = pool->mark_nodes; node; node = node->next) {
+        stats->nodes++;
+        stats->bytes_total += node->endp - (char *)node;
+        stats->bytes_alloc += node->first_avail
+                              - ((char *)node + APR_MEMNODE_T_SIZE);
+        stats->bytes_wasted += node_free_space(node);
+    }
+
+    stats->bytes_peak = pool->stat_peak;
+    if (stats->bytes_peak < stats->bytes_alloc)
+        stats->bytes_peak = stats->bytes_alloc;
+}
+
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool, apr_pool_stats_t *stats)
+{
+    pool_concurrency_set_used(pool);
+    pool_stats(pool, stats);
+    pool_concurrency_set_idle(pool);
+}
 
 /*
  * Pool creation/destruction
@@ -964,6 +2055,18 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     /* Clear the user data. */
     pool->user_data = NULL;
 
+    /* Remember the peak usage before forgetting about it */
+    pool_stats_peak_update(pool);
+
+    /* Forget about the marks */
+    pool->stat_alloc = 0;
+    pool->mark = NULL;
+    pool->active_marked = 0;
+    if (pool->mark_nodes) {
+        allocator_free(pool->allocator, pool->mark_nodes);
+        pool->mark_nodes = NULL;
+    }
+
     /* Find the node attached to the pool structure, reset it, make
      * it the active node and free the rest of the nodes.
      */
@@ -985,11 +2088,47 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     pool_concurrency_set_idle(pool);
 }
 
+/* Remove the pool from the parents child list */
+static void pool_detach(apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+
+    if ((mutex = apr_allocator_mutex_get(pool->parent->allocator)) != NULL)
+        apr_thread_mutex_lock(mutex);
+#endif /* APR_HAS_THREADS */
+
+    if ((*pool->ref = pool->sibling) != NULL)
+        pool->sibling->ref = pool->ref;
+
+#if APR_HAS_THREADS
+    if (mutex)
+        apr_thread_mutex_unlock(mutex);
+#endif /* APR_HAS_THREADS */
+}
+
+#if APR_HAS_THREADS
+/* Wait for the deferred pools using the given allocator to be destroyed */
+static void pool_reaper_wait(apr_allocator_t *allocator)
+{
+    apr_thread_mutex_lock(reaper_mutex);
+    while (allocator->deferred)
+        apr_thread_cond_wait(reaper_done_cond, reaper_mutex);
+    apr_thread_mutex_unlock(reaper_mutex);
+}
+#endif /* APR_HAS_THREADS */
+
 APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 {
     apr_memnode_t *active;
     apr_allocator_t *allocator;
 
+#if APR_HAS_THREADS
+    /* The allocator (and its mutex) must outlive the deferred pools */
+    if (reaper_running() && apr_allocator_owner_get(pool->allocator) == pool)
+        pool_reaper_wait(pool->allocator);
+#endif /* APR_HAS_THREADS */
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -1011,22 +2150,8 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     free_proc_chain(pool->subprocesses);
 
     /* Remove the pool from the parents child list */
-    if (pool->parent) {
-#if APR_HAS_THREADS
-        apr_thread_mutex_t *mutex;
-
-        if ((mutex = apr_allocator_mutex_get(pool->parent->allocator)) != NULL)
-            apr_thread_mutex_lock(mutex);
-#endif /* APR_HAS_THREADS */
-
-        if ((*pool->ref = pool->sibling) != NULL)
-            pool->sibling->ref = pool->ref;
-
-#if APR_HAS_THREADS
-        if (mutex)
-            apr_thread_mutex_unlock(mutex);
-#endif /* APR_HAS_THREADS */
-    }
+    if (pool->parent)
+        pool_detach(pool);
 
     /* Find the block attached to the pool structure.  Save a copy of the
      * allocator pointer, because the pool struct soon will be no more.
@@ -1035,29 +2160,128 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     active = pool->self;
     *active->ref = NULL;
 
+    if (pool->mark_nodes)
+        allocator_free(allocator, pool->mark_nodes);
+
+#if APR_HAS_THREADS
+    if (apr_allocator_owner_get(allocator) == pool) {
+        /* Make sure to remove the lock, since it is highly likely to
+         * be invalid now.
+         */
+        apr_allocator_mutex_set(allocator, NULL);
+    }
+#endif /* APR_HAS_THREADS */
+
+    /* Free all the nodes in the pool (including the node holding the
+     * pool struct), by giving them back to the allocator.
+     */
+    allocator_free(allocator, active);
+
+    /* If this pool happens to be the owner of the allocator, free
+     * everything in the allocator (that includes the pool struct
+     * and the allocator).  Don't worry about destroying the optional mutex
+     * in the allocator, it will have been destroyed by the cleanup function.
+     */
+    if (apr_allocator_owner_get(allocator) == pool) {
+        apr_allocator_destroy(allocator);
+    }
+    APR_IF_VALGRIND(VALGRIND_DESTROY_MEMPOOL(pool));
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC pool_reaper(apr_thread_t *thd, void *data)
+{
+    apr_pool_t *pool;
+    apr_allocator_t *allocator;
+
+    apr_thread_mutex_lock(reaper_mutex);
+    for (;;) {
+        if ((pool = reaper_list) == NULL) {
+            if (reaper_stop)
+                break;
+            apr_thread_cond_wait(reaper_cond, reaper_mutex);
+            continue;
+        }
+        if ((reaper_list = pool->sibling) == NULL)
+            reaper_tail = &reaper_list;
+        apr_thread_mutex_unlock(reaper_mutex);
+
+        /* The allocator goes with the pool if it owns it */
+        allocator = pool->allocator;
+        if (apr_allocator_owner_get(allocator) == pool)
+            allocator = NULL;
+
+        pool->sibling = NULL;
+        apr_pool_destroy(pool);
+
+        apr_thread_mutex_lock(reaper_mutex);
+        reaper_pending--;
+        if (allocator && --allocator->deferred == 0)
+            apr_thread_cond_broadcast(reaper_done_cond);
+    }
+    apr_thread_mutex_unlock(reaper_mutex);
+
+    return NULL;
+}
+
+/* Must be called with the reaper mutex held */
+static apr_status_t pool_reaper_start(void)
+{
+    apr_thread_t *thread;
+    apr_status_t rv;
+
+    rv = apr_thread_create(&thread, NULL, pool_reaper, NULL, reaper_pool);
+    if (rv == APR_SUCCESS) {
+        reaper_thread = thread;
+#if APR_HAS_FORK
+        reaper_pid = getpid();
+#endif
+    }
+
+    return rv;
+}
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(void) apr_pool_destroy_deferred(apr_pool_t *pool)
+{
 #if APR_HAS_THREADS
-    if (apr_allocator_owner_get(allocator) == pool) {
-        /* Make sure to remove the lock, since it is highly likely to
-         * be invalid now.
-         */
-        apr_allocator_mutex_set(allocator, NULL);
+    apr_allocator_t *allocator = pool->allocator;
+    int owner = (apr_allocator_owner_get(allocator) == pool);
+
+    /* Nodes are given back to the allocator from the reaper thread */
+    if (reaper_mutex && (owner || apr_allocator_mutex_get(allocator))
+        && (reaper_running() || !reaper_thread)) {
+        apr_thread_mutex_lock(reaper_mutex);
+
+        if (reaper_pending < reaper_max && !reaper_stop
+            && !(owner && allocator->deferred)
+            && (reaper_thread || pool_reaper_start() == APR_SUCCESS)) {
+            if (pool->parent) {
+                pool_detach(pool);
+                pool->parent = NULL;
+            }
+            pool->sibling = NULL;
+            *reaper_tail = pool;
+            reaper_tail = &pool->sibling;
+
+            reaper_pending++;
+            if (!owner)
+                allocator->deferred++;
+
+            apr_thread_cond_signal(reaper_cond);
+            apr_thread_mutex_unlock(reaper_mutex);
+            return;
+        }
+        apr_thread_mutex_unlock(reaper_mutex);
     }
 #endif /* APR_HAS_THREADS */
 
-    /* Free all the nodes in the pool (including the node holding the
-     * pool struct), by giving them back to the allocator.
-     */
-    allocator_free(allocator, active);
+    apr_pool_destroy(pool);
+}
 
-    /* If this pool happens to be the owner of the allocator, free
-     * everything in the allocator (that includes the pool struct
-     * and the allocator).  Don't worry about destroying the optional mutex
-     * in the allocator, it will have been destroyed by the cleanup function.
-     */
-    if (apr_allocator_owner_get(allocator) == pool) {
-        apr_allocator_destroy(allocator);
-    }
-    APR_IF_VALGRIND(VALGRIND_DESTROY_MEMPOOL(pool));
+APR_DECLARE(void) apr_pool_reaper_max_set(apr_size_t max)
+{
+    reaper_max = max;
 }
 
 APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
@@ -1122,6 +2346,11 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->stat_peak = 0;
+    pool->stat_alloc = 0;
+    pool->mark = NULL;
+    pool->mark_nodes = NULL;
+    pool->active_marked = 0;
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1209,6 +2438,11 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->stat_peak = 0;
+    pool->stat_alloc = 0;
+    pool->mark = NULL;
+    pool->mark_nodes = NULL;
+    pool->active_marked = 0;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
@@ -1277,7 +2511,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         size = APR_PSPRINTF_MIN_STRINGSIZE;
 
     node = active->next;
-    if (!ps->got_a_new_node && size <= node_free_space(node)) {
+    if (!ps->got_a_new_node && !pool->mark
+        && size <= node_free_space(node)) {
 
         list_remove(node);
         list_insert(node, active);
@@ -1285,6 +2520,7 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         node->free_index = 0;
 
         pool->active = node;
+        pool->stat_alloc += node_used_space(active) - node_used_space(node);
 
         free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                                 BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
@@ -1362,11 +2598,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     struct psprintf_data ps;
     char *strp;
     apr_size_t size;
-    apr_memnode_t *active, *node;
-    apr_size_t free_index;
 
     pool_concurrency_set_used(pool);
-    ps.node = active = pool->active;
+    ps.node = pool->active;
     ps.pool = pool;
     ps.vbuff.curpos  = ps.node->first_avail;
 
@@ -1433,33 +2667,7 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
         return strp;
     }
 
-    active = pool->active;
-    node = ps.node;
-
-    node->free_index = 0;
-
-    list_insert(node, active);
-
-    pool->active = node;
-
-    free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
-                            BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
-
-    active->free_index = (apr_uint32_t)free_index;
-    node = active->next;
-
-    if (free_index >= node->free_index) {
-        pool_concurrency_set_idle(pool);
-        return strp;
-    }
-
-    do {
-        node = node->next;
-    }
-    while (free_index < node->free_index);
-
-    list_remove(active);
-    list_insert(active, node);
+    pool_node_activate(pool, ps.node);
 
     pool_concurrency_set_idle(pool);
     return strp;
@@ -1838,13 +3046,97 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_grow(apr_pool_t *pool, void *mem,
+                                    apr_size_t old_size, apr_size_t new_size)
+{
+    void *new_mem;
+
+    apr_pool_check_integrity(pool);
+
+    if (mem != NULL && new_size <= old_size)
+        return mem;
+
+    /* Every block is malloc()ed on its own, always move */
+    if ((new_mem = pool_alloc(pool, new_size)) != NULL && mem != NULL)
+        memcpy(new_mem, mem, old_size);
+
+    return new_mem;
+}
+
+#define POOL_POISON_BYTE 'A'
+
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        return NULL;
+
+    apr_pool_check_integrity(pool);
+
+    /* Every block is malloc()ed on its own, over-allocate to align */
+    if (size + alignment - 1 < size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = pool_alloc(pool, size + alignment - 1)) != NULL)
+        mem = ALIGN_PTR(mem, alignment);
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment)
+{
+    void *mem;
+
+    if ((mem = apr_palloc_aligned(pool, size, alignment)) != NULL)
+        memset(mem, 0, size);
+
+    return mem;
+}
+
+static void pool_mark_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    mark->node = pool->nodes;
+    mark->index = pool->nodes ? pool->nodes->index : 0;
+}
+
+static void pool_release_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_size_t index, first;
+
+    /* Free the blocks allocated since the mark, scribbling over them
+     * first to help highlight use-after-free issues. */
+    while ((node = pool->nodes) != NULL) {
+        first = (node == mark->node) ? mark->index : 0;
+
+        for (index = first; index < node->index; index++) {
+            memset(node->beginp[index], POOL_POISON_BYTE,
+                   (char *)node->endp[index] - (char *)node->beginp[index]);
+            free(node->beginp[index]);
+            pool->stat_alloc--;
+        }
+        node->index = first;
+
+        if (node == mark->node)
+            break;
+
+        pool->nodes = node->next;
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+}
+
 
 /*
  * Pool creation/destruction (debug)
  */
 
-#define POOL_POISON_BYTE 'A'
-
 static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
 {
     debug_node_t *node;
@@ -1870,6 +3162,7 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
     run_cleanups(&pool->cleanups);
     pool->free_cleanups = NULL;
     pool->cleanups = NULL;
+    pool->mark = NULL;
 
     /* If new child pools showed up, this is a reason to raise a flag */
     if (pool->child)
@@ -2002,6 +3295,16 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *pool,
     pool_destroy_debug(pool, file_line);
 }
 
+APR_DECLARE(void) apr_pool_destroy_deferred(apr_pool_t *pool)
+{
+    /* Debug pools are always destroyed inline */
+    apr_pool_destroy_debug(pool, "apr_pool_destroy_deferred");
+}
+
+APR_DECLARE(void) apr_pool_reaper_max_set(apr_size_t max)
+{
+}
+
 APR_DECLARE(apr_status_t) apr_pool_create_ex_debug(apr_pool_t **newpool,
                                                    apr_pool_t *parent,
                                                    apr_abortfunc_t abort_fn,
@@ -2328,6 +3631,22 @@ APR_DECLARE(apr_size_t) apr_pool_num_bytes(apr_pool_t *pool, int recurse)
     return size;
 }
 
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool, apr_pool_stats_t *stats)
+{
+    debug_node_t *node;
+
+    apr_pool_check_integrity(pool);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->tag = pool->tag;
+
+    /* Each allocation is a node of its own in debug mode */
+    for (node = pool->nodes; node; node = node->next)
+        stats->nodes += node->index;
+    pool_num_bytes(pool, &stats->bytes_alloc);
+    stats->bytes_total = stats->bytes_peak = stats->bytes_alloc;
+}
+
 APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 {
 }
@@ -2437,10 +3756,46 @@ APR_DECLARE(const char *) apr_pool_get_tag(apr_pool_t *pool)
     return pool->tag;
 }
 
+static int pool_stats_walk(apr_pool_t *pool, apr_pool_stats_fn_t *fn,
+                           int depth, void *data)
+{
+    apr_pool_stats_t stats;
+    apr_pool_t *child;
+    int rv;
+
+    apr_pool_stats_get(pool, &stats);
+    if ((rv = fn(pool, &stats, depth, data)) != 0)
+        return rv;
+
+    for (child = pool->child; child; child = child->sibling) {
+        if ((rv = pool_stats_walk(child, fn, depth + 1, data)) != 0)
+            return rv;
+    }
+
+    return 0;
+}
+
+APR_DECLARE(int) apr_pool_stats_walk(apr_pool_t *pool, apr_pool_stats_fn_t *fn,
+                                     void *data)
+{
+    return pool_stats_walk(pool, fn, 0, data);
+}
+
 /*
  * User data management
  */
 
+/* The user data of a marked pool may be allocated before the mark, so it
+ * is copied before being modified, @see apr_pool_release_to_mark().
+ */
+static APR_INLINE void userdata_cow(apr_pool_t *pool)
+{
+    if (pool->user_data == NULL)
+        pool->user_data = apr_hash_make(pool);
+    else if (pool->mark && pool->user_data == pool->mark->user_data)
+        pool->user_data = apr_hash_copy(pool, pool->user_data);
+}
+
 APR_DECLARE(apr_status_t) apr_pool_userdata_set(const void *data, const char *key,
                                                 apr_status_t (*cleanup) (void *),
                                                 apr_pool_t *pool)
@@ -2449,8 +3804,7 @@ APR_DECLARE(apr_status_t) apr_pool_userdata_set(const void *data, const char *ke
     apr_pool_check_integrity(pool);
 #endif /* APR_POOL_DEBUG */
 
-    if (pool->user_data == NULL)
-        pool->user_data = apr_hash_make(pool);
+    userdata_cow(pool);
 
     if (apr_hash_get(pool->user_data, key, APR_HASH_KEY_STRING) == NULL) {
         char *new_key = apr_pstrdup(pool, key);
@@ -2475,8 +3829,7 @@ APR_DECLARE(apr_status_t) apr_pool_userdata_setn(const void *data,
     apr_pool_check_integrity(pool);
 #endif /* APR_POOL_DEBUG */
 
-    if (pool->user_data == NULL)
-        pool->user_data = apr_hash_make(pool);
+    userdata_cow(pool);
 
     apr_hash_set(pool->user_data, key, APR_HASH_KEY_STRING, data);
 
@@ -2508,14 +3861,60 @@ APR_DECLARE(apr_status_t) apr_pool_userdata_get(void **data, const char *key,
  * Cleanup
  */
 
-struct cleanup_t {
-    struct cleanup_t *next;
+struct apr_pool_cleanup_t {
+    struct apr_pool_cleanup_t *next;
+    /** Where the cleanup is linked from, NULL when it is not on a list */
+    struct apr_pool_cleanup_t **ref;
     const void *data;
     apr_status_t (*plain_cleanup_fn)(void *data);
     apr_status_t (*child_cleanup_fn)(void *data);
 };
 
-APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
+static APR_INLINE cleanup_t *cleanup_alloc(apr_pool_t *p)
+{
+    cleanup_t *c;
+
+    if (p->free_cleanups) {
+        /* reuse a cleanup structure */
+        c = p->free_cleanups;
+        p->free_cleanups = c->next;
+    } else {
+        c = apr_palloc(p, sizeof(cleanup_t));
+    }
+
+    return c;
+}
+
+static APR_INLINE void cleanup_insert(cleanup_t **list, cleanup_t *c)
+{
+    if ((c->next = *list) != NULL)
+        c->next->ref = &c->next;
+    c->ref = list;
+    *list = c;
+}
+
+static APR_INLINE void cleanup_remove(cleanup_t *c)
+{
+    if ((*c->ref = c->next) != NULL)
+        c->next->ref = c->ref;
+    c->ref = NULL;
+}
+
+static APR_INLINE void cleanup_recycle(apr_pool_t *p, cleanup_t *c)
+{
+    /* Under a mark, the cleanup may be allocated from memory about to be
+     * released, leave it until the pool is cleared.
+     */
+    if (p->mark)
+        return;
+
+    /* move to freelist */
+    c->next = p->free_cleanups;
+    p->free_cleanups = c;
+}
+
+APR_DECLARE(apr_pool_cleanup_t *) apr_pool_cleanup_register_handle(
+                      apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *data),
                       apr_status_t (*child_cleanup_fn)(void *data))
 {
@@ -2529,20 +3928,24 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
     }
 #endif /* APR_POOL_DEBUG */
 
-    if (p != NULL) {
-        if (p->free_cleanups) {
-            /* reuse a cleanup structure */
-            c = p->free_cleanups;
-            p->free_cleanups = c->next;
-        } else {
-            c = apr_palloc(p, sizeof(cleanup_t));
-        }
-        c->data = data;
-        c->plain_cleanup_fn = plain_cleanup_fn;
-        c->child_cleanup_fn = child_cleanup_fn;
-        c->next = p->cleanups;
-        p->cleanups = c;
-    }
+    if (p == NULL)
+        return NULL;
+
+    c = cleanup_alloc(p);
+    c->data = data;
+    c->plain_cleanup_fn = plain_cleanup_fn;
+    c->child_cleanup_fn = child_cleanup_fn;
+    cleanup_insert(&p->cleanups, c);
+
+    return c;
+}
+
+APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
+                      apr_status_t (*plain_cleanup_fn)(void *data),
+                      apr_status_t (*child_cleanup_fn)(void *data))
+{
+    apr_pool_cleanup_register_handle(p, data, plain_cleanup_fn,
+                                     child_cleanup_fn);
 }
 
 APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
@@ -2555,24 +3958,17 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
 #endif /* APR_POOL_DEBUG */
 
     if (p != NULL) {
-        if (p->free_cleanups) {
-            /* reuse a cleanup structure */
-            c = p->free_cleanups;
-            p->free_cleanups = c->next;
-        } else {
-            c = apr_palloc(p, sizeof(cleanup_t));
-        }
+        c = cleanup_alloc(p);
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
-        c->next = p->pre_cleanups;
-        p->pre_cleanups = c;
+        cleanup_insert(&p->pre_cleanups, c);
     }
 }
 
 APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
                       apr_status_t (*cleanup_fn)(void *))
 {
-    cleanup_t *c, **lastp;
+    cleanup_t *c;
 
 #if APR_POOL_DEBUG
     apr_pool_check_integrity(p);
@@ -2582,7 +3978,6 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
         return;
 
     c = p->cleanups;
-    lastp = &p->cleanups;
     while (c) {
 #if APR_POOL_DEBUG
         /* Some cheap loop detection to catch a corrupt list: */
@@ -2594,20 +3989,16 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 #endif
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
-            *lastp = c->next;
-            /* move to freelist */
-            c->next = p->free_cleanups;
-            p->free_cleanups = c;
+            cleanup_remove(c);
+            cleanup_recycle(p, c);
             break;
         }
 
-        lastp = &c->next;
         c = c->next;
     }
 
     /* Remove any pre-cleanup as well */
     c = p->pre_cleanups;
-    lastp = &p->pre_cleanups;
     while (c) {
 #if APR_POOL_DEBUG
         /* Some cheap loop detection to catch a corrupt list: */
@@ -2619,19 +4010,31 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 #endif
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
-            *lastp = c->next;
-            /* move to freelist */
-            c->next = p->free_cleanups;
-            p->free_cleanups = c;
+            cleanup_remove(c);
+            cleanup_recycle(p, c);
             break;
         }
 
-        lastp = &c->next;
         c = c->next;
     }
 
 }
 
+APR_DECLARE(void) apr_pool_cleanup_kill_handle(apr_pool_t *p,
+                                               apr_pool_cleanup_t *c)
+{
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    /* Running or already run? */
+    if (c->ref == NULL)
+        return;
+
+    cleanup_remove(c);
+    cleanup_recycle(p, c);
+}
+
 APR_DECLARE(void) apr_pool_child_cleanup_set(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *),
                       apr_status_t (*child_cleanup_fn)(void *))
@@ -2663,14 +4066,123 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
     return (*cleanup_fn)(data);
 }
 
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_handle(apr_pool_t *p,
+                                                      apr_pool_cleanup_t *c)
+{
+    apr_status_t (*cleanup_fn)(void *) = c->plain_cleanup_fn;
+    void *data = (void *)c->data;
+
+    apr_pool_cleanup_kill_handle(p, c);
+    return (*cleanup_fn)(data);
+}
+
+/*
+ * Marks
+ */
+
+static apr_status_t mark_cleanup(void *data)
+{
+    return APR_SUCCESS;
+}
+
+static cleanup_t *mark_sentinel(apr_pool_t *pool, apr_pool_mark_t *mark,
+                                cleanup_t **list)
+{
+    cleanup_t *c = cleanup_alloc(pool);
+
+    c->data = mark;
+    c->plain_cleanup_fn = mark_cleanup;
+    c->child_cleanup_fn = mark_cleanup;
+    cleanup_insert(list, c);
+
+    return c;
+}
+
+/* Run the cleanups of the list registered since the mark, skipping the
+ * sentinels of the inner marks not released.
+ */
+static void mark_run_cleanups(cleanup_t **list, cleanup_t *sentinel)
+{
+    cleanup_t *c;
+
+    while ((c = *list) != NULL && c != sentinel) {
+        cleanup_remove(c);
+        if (c->plain_cleanup_fn != mark_cleanup)
+            (*c->plain_cleanup_fn)((void *)c->data);
+    }
+}
+
+static void mark_sentinel_remove(apr_pool_t *pool, cleanup_t *c)
+{
+    if (c->ref) {
+        cleanup_remove(c);
+        cleanup_recycle(pool, c);
+    }
+}
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(pool);
+#endif /* APR_POOL_DEBUG */
+
+    /* The sentinels where the (pre-)cleanups to run on release stop,
+     * allocated before the mark so that they survive the release.
+     */
+    mark->cleanup = mark_sentinel(pool, mark, &pool->cleanups);
+    mark->pre_cleanup = mark_sentinel(pool, mark, &pool->pre_cleanups);
+
+    /* Both lists only grow at their head */
+    mark->subprocesses = pool->subprocesses;
+    mark->user_data = pool->user_data;
+
+    pool_mark_memory(pool, mark);
+
+    mark->prev = pool->mark;
+    pool->mark = mark;
+}
+
+APR_DECLARE(void) apr_pool_release_to_mark(apr_pool_t *pool,
+                                           apr_pool_mark_t *mark)
+{
+    struct process_chain *pc;
+
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(pool);
+#endif /* APR_POOL_DEBUG */
+
+    /* Same order as apr_pool_clear(), for what happened since the mark */
+    mark_run_cleanups(&pool->pre_cleanups, mark->pre_cleanup);
+    mark_run_cleanups(&pool->cleanups, mark->cleanup);
+
+    if (pool->subprocesses != mark->subprocesses) {
+        for (pc = pool->subprocesses; pc->next != mark->subprocesses;
+             pc = pc->next)
+            ;
+        pc->next = NULL;
+        free_proc_chain(pool->subprocesses);
+        pool->subprocesses = mark->subprocesses;
+    }
+
+    /* The user data set since the mark went to a copy, @see
+     * userdata_cow()
+     */
+    pool->user_data = mark->user_data;
+
+    pool_release_memory(pool, mark);
+
+    pool->mark = mark->prev;
+    mark_sentinel_remove(pool, mark->pre_cleanup);
+    mark_sentinel_remove(pool, mark->cleanup);
+}
+
 static void run_cleanups(cleanup_t **cref)
 {
-    cleanup_t *c = *cref;
+    cleanup_t *c;
 
-    while (c) {
-        *cref = c->next;
+    while ((c = *cref) != NULL) {
+        cleanup_remove(c);
         (*c->plain_cleanup_fn)((void *)c->data);
-        c = *cref;
     }
 }
 
@@ -2678,12 +4190,11 @@ static void run_cleanups(cleanup_t **cref)
 
 static void run_child_cleanups(cleanup_t **cref)
 {
-    cleanup_t *c = *cref;
+    cleanup_t *c;
 
-    while (c) {
-        *cref = c->next;
+    while ((c = *cref) != NULL) {
+        cleanup_remove(c);
         (*c->child_cleanup_fn)((void *)c->data);
-        c = *cref;
     }
 }
 
@@ -0,0 +1,419 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+
+#include "apr_slab.h"
+#include "apr_allocator.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* for malloc and free */
+#endif
+
+/*
+ * Objects are carved out of memnodes (slabs) taken from the allocator,
+ * and once freed they are linked (through their first word) in a LIFO
+ * list, so both allocation and free are O(1).  Slabs are only given back
+ * to the allocator with the cache.
+ */
+
+/* Minimum number of objects per slab */
+#define SLAB_MIN_OBJECTS    16
+
+/* Number of objects a magazine holds, it gives/takes half of them at
+ * once to/from the cache.
+ */
+#define MAGAZINE_SIZE       32
+#define MAGAZINE_BATCH      (MAGAZINE_SIZE / 2)
+
+typedef struct slab_magazine_t slab_magazine_t;
+
+struct slab_magazine_t {
+    slab_magazine_t *next;
+    slab_magazine_t **ref;
+    apr_slab_t      *slab;
+    apr_size_t       count;
+    void            *free;
+};
+
+struct apr_slab_t {
+    apr_pool_t         *pool;
+    apr_allocator_t    *allocator;
+    /** The allocator created for the cache, if the pool has none */
+    apr_allocator_t    *own_allocator;
+    apr_size_t          size;
+    apr_size_t          slab_size;
+    /** The slabs, and the space left in the current one */
+    apr_memnode_t      *nodes;
+    char               *avail;
+    char               *endp;
+    /** Free objects list */
+    void               *free;
+    apr_size_t          nfree;
+    apr_size_t          slabs;
+    apr_size_t          bytes;
+    apr_size_t          objects;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    apr_threadkey_t    *key;
+    slab_magazine_t    *magazines;
+#endif
+};
+
+#define OBJ_NEXT(mem) (*(void **)(mem))
+
+#if APR_HAS_THREADS
+#define slab_lock(slab) \
+    do { if ((slab)->mutex) apr_thread_mutex_lock((slab)->mutex); } while (0)
+#define slab_unlock(slab) \
+    do { if ((slab)->mutex) apr_thread_mutex_unlock((slab)->mutex); } while (0)
+#else
+#define slab_lock(slab)
+#define slab_unlock(slab)
+#endif
+
+/* Must be called with the cache locked */
+static APR_INLINE void *slab_take(apr_slab_t *slab)
+{
+    apr_memnode_t *node;
+    void *mem;
+
+    if ((mem = slab->free) != NULL) {
+        slab->free = OBJ_NEXT(mem);
+        slab->nfree--;
+        return mem;
+    }
+
+    if ((apr_size_t)(slab->endp - slab->avail) < slab->size) {
+        node = apr_allocator_alloc(slab->allocator, slab->slab_size);
+        if (node == NULL)
+            return NULL;
+
+        node->next = slab->nodes;
+        slab->nodes = node;
+        slab->avail = node->first_avail;
+        slab->endp = node->endp;
+        slab->slabs++;
+        slab->bytes += node->endp - (char *)node;
+    }
+
+    mem = slab->avail;
+    slab->avail += slab->size;
+    slab->objects++;
+
+    return mem;
+}
+
+/* Must be called with the cache locked */
+static APR_INLINE void slab_give(apr_slab_t *slab, void *mem)
+{
+    OBJ_NEXT(mem) = slab->free;
+    slab->free = mem;
+    slab->nfree++;
+}
+
+#if APR_HAS_THREADS
+
+/* Thread exit: give the objects of the magazine back to the cache */
+static void slab_magazine_destroy(void *data)
+{
+    slab_magazine_t *mag = data;
+    apr_slab_t *slab = mag->slab;
+    void *mem;
+
+    slab_lock(slab);
+    if ((*mag->ref = mag->next) != NULL)
+        mag->next->ref = mag->ref;
+    while ((mem = mag->free) != NULL) {
+        mag->free = OBJ_NEXT(mem);
+        slab_give(slab, mem);
+    }
+    slab_unlock(slab);
+
+    free(mag);
+}
+
+static slab_magazine_t *slab_magazine_get(apr_slab_t *slab)
+{
+    slab_magazine_t *mag;
+    void *data;
+
+    if (apr_threadkey_private_get(&data, slab->key) != APR_SUCCESS)
+        return NULL;
+
+    if ((mag = data) == NULL) {
+        if ((mag = malloc(sizeof(slab_magazine_t))) == NULL)
+            return NULL;
+
+        memset(mag, 0, sizeof(slab_magazine_t));
+        mag->slab = slab;
+
+        if (apr_threadkey_private_set(mag, slab->key) != APR_SUCCESS) {
+            free(mag);
+            return NULL;
+        }
+
+        slab_lock(slab);
+        if ((mag->next = slab->magazines) != NULL)
+            mag->next->ref = &mag->next;
+        slab->magazines = mag;
+        mag->ref = &slab->magazines;
+        slab_unlock(slab);
+    }
+
+    return mag;
+}
+
+static void *slab_magazine_alloc(apr_slab_t *slab)
+{
+    slab_magazine_t *mag;
+    void *mem;
+
+    if ((mag = slab_magazine_get(slab)) == NULL) {
+        slab_lock(slab);
+        mem = slab_take(slab);
+        slab_unlock(slab);
+
+        return mem;
+    }
+
+    if (mag->count == 0) {
+        slab_lock(slab);
+        while (mag->count < MAGAZINE_BATCH
+               && (mem = slab_take(slab)) != NULL) {
+            OBJ_NEXT(mem) = mag->free;
+            mag->free = mem;
+            mag->count++;
+        }
+        slab_unlock(slab);
+
+        if (mag->count == 0)
+            return NULL;
+    }
+
+    mem = mag->free;
+    mag->free = OBJ_NEXT(mem);
+    mag->count--;
+
+    return mem;
+}
+
+static void slab_magazine_free(apr_slab_t *slab, void *mem)
+{
+    slab_magazine_t *mag;
+
+    if ((mag = slab_magazine_get(slab)) == NULL) {
+        slab_lock(slab);
+        slab_give(slab, mem);
+        slab_unlock(slab);
+
+        return;
+    }
+
+    if (mag->count >= MAGAZINE_SIZE) {
+        void *spill;
+
+        slab_lock(slab);
+        while (mag->count > MAGAZINE_SIZE - MAGAZINE_BATCH) {
+            spill = mag->free;
+            mag->free = OBJ_NEXT(spill);
+            mag->count--;
+            slab_give(slab, spill);
+        }
+        slab_unlock(slab);
+    }
+
+    OBJ_NEXT(mem) = mag->free;
+    mag->free = mem;
+    mag->count++;
+}
+
+#endif /* APR_HAS_THREADS */
+
+static apr_status_t slab_cleanup(void *data)
+{
+    apr_slab_t *slab = data;
+
+#if APR_HAS_THREADS
+    if (slab->key) {
+        slab_magazine_t *mag;
+
+        /* No destructor must run for this cache from now on */
+        apr_threadkey_private_delete(slab->key);
+        slab->key = NULL;
+
+        while ((mag = slab->magazines) != NULL) {
+            slab->magazines = mag->next;
+            free(mag);
+        }
+    }
+#endif
+
+    if (slab->nodes) {
+        apr_allocator_free(slab->allocator, slab->nodes);
+        slab->nodes = NULL;
+    }
+    if (slab->own_allocator) {
+        apr_allocator_destroy(slab->own_allocator);
+        slab->own_allocator = NULL;
+    }
+
+    slab->free = NULL;
+    slab->avail = slab->endp = NULL;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **newslab,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+{
+    apr_slab_t *slab;
+    apr_status_t rv;
+
+    if (size == 0)
+        return APR_EINVAL;
+#if !APR_HAS_THREADS
+    if (flags & (APR_SLAB_THREADSAFE | APR_SLAB_MAGAZINES))
+        return APR_ENOTIMPL;
+#endif
+
+    slab = apr_pcalloc(pool, sizeof(apr_slab_t));
+    slab->pool = pool;
+
+    /* Room for the free list link */
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+    slab->size = APR_ALIGN_DEFAULT(size);
+    slab->slab_size = slab->size * SLAB_MIN_OBJECTS;
+
+    if ((slab->allocator = apr_pool_allocator_get(pool)) == NULL) {
+        if ((rv = apr_allocator_create(&slab->own_allocator)) != APR_SUCCESS)
+            return rv;
+        slab->allocator = slab->own_allocator;
+    }
+
+#if APR_HAS_THREADS
+    if (flags & (APR_SLAB_THREADSAFE | APR_SLAB_MAGAZINES)) {
+        rv = apr_thread_mutex_create(&slab->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                     pool);
+        if (rv != APR_SUCCESS) {
+            slab_cleanup(slab);
+            return rv;
+        }
+    }
+    if (flags & APR_SLAB_MAGAZINES) {
+        rv = apr_threadkey_private_create(&slab->key, slab_magazine_destroy,
+                                          pool);
+        if (rv != APR_SUCCESS) {
+            slab->key = NULL;
+            slab_cleanup(slab);
+            return rv;
+        }
+    }
+#endif
+
+    apr_pool_cleanup_register(pool, slab, slab_cleanup,
+                              apr_pool_cleanup_null);
+
+    *newslab = slab;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+{
+    apr_abortfunc_t abort_fn;
+    void *mem;
+
+#if APR_HAS_THREADS
+    if (slab->key) {
+        mem = slab_magazine_alloc(slab);
+    }
+    else
+#endif
+    {
+        slab_lock(slab);
+        mem = slab_take(slab);
+        slab_unlock(slab);
+    }
+
+    if (mem == NULL && (abort_fn = apr_pool_abort_get(slab->pool)) != NULL)
+        abort_fn(APR_ENOMEM);
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+{
+    void *mem;
+
+    if ((mem = apr_slab_alloc(slab)) != NULL)
+        memset(mem, 0, slab->size);
+
+    return mem;
+}
+
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *mem)
+{
+    if (mem == NULL)
+        return;
+
+#if APR_HAS_THREADS
+    if (slab->key) {
+        slab_magazine_free(slab, mem);
+        return;
+    }
+#endif
+
+    slab_lock(slab);
+    slab_give(slab, mem);
+    slab_unlock(slab);
+}
+
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab, apr_slab_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    slab_lock(slab);
+
+    stats->size = slab->size;
+    stats->slabs = slab->slabs;
+    stats->bytes = slab->bytes;
+    stats->objects = slab->objects;
+    stats->free = slab->nfree;
+#if APR_HAS_THREADS
+    {
+        slab_magazine_t *mag;
+
+        for (mag = slab->magazines; mag; mag = mag->next)
+            stats->cached += mag->count;
+    }
+#endif
+    stats->inuse = stats->objects - stats->free - stats->cached;
+
+    slab_unlock(slab);
+}
+
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+{
+    apr_pool_cleanup_run(slab->pool, slab, slab_cleanup);
+}
@@ -28,6 +28,16 @@
 #include "apr_mmap.h"
 #include "apr_errno.h"
 
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #if APR_HAS_MMAP || defined(BEOS)
 
 APR_DECLARE(apr_status_t) apr_mmap_offset(void **addr, apr_mmap_t *mmap,
@@ -40,4 +50,49 @@ APR_DECLARE(apr_status_t) apr_mmap_offset(void **addr, apr_mmap_t *mmap,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_mmap_advise(apr_mmap_t *mmap, apr_off_t offset,
+                                          apr_size_t len, int advice)
+{
+#if defined(HAVE_MADVISE) && defined(MADV_WILLNEED)
+    apr_size_t pagesize = sysconf(_SC_PAGESIZE);
+    apr_size_t skew;
+    char *addr;
+    int native;
+
+    if (offset < 0 || (apr_size_t)offset > mmap->size
+        || len > mmap->size - offset)
+        return APR_EINVAL;
+
+    switch (advice) {
+    case APR_FADVISE_NORMAL:
+        native = MADV_NORMAL;
+        break;
+    case APR_FADVISE_SEQUENTIAL:
+        native = MADV_SEQUENTIAL;
+        break;
+    case APR_FADVISE_RANDOM:
+        native = MADV_RANDOM;
+        break;
+    case APR_FADVISE_WILLNEED:
+        native = MADV_WILLNEED;
+        break;
+    case APR_FADVISE_DONTNEED:
+        native = MADV_DONTNEED;
+        break;
+    default:
+        return APR_EINVAL;
+    }
+
+    /* The address must be page aligned */
+    addr = (char *) mmap->mm + offset;
+    skew = (apr_size_t)addr % pagesize;
+
+    if (madvise(addr - skew, len + skew, native) == -1)
+        return errno;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 #endif
@@ -82,6 +82,7 @@ APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
     uint32 pages = 0;
 #else
     apr_int32_t native_flags = 0;
+    int map_flags = MAP_SHARED;
 #endif
 
 #if APR_HAS_LARGE_FILES && defined(HAVE_MMAP64)
@@ -130,7 +131,13 @@ APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
         native_flags |= PROT_READ;
     }
 
-    mm = mmap(NULL, size, native_flags, MAP_SHARED, file->filedes, offset);
+#ifdef MAP_POPULATE
+    if (flag & APR_MMAP_POPULATE) {
+        map_flags |= MAP_POPULATE;
+    }
+#endif
+
+    mm = mmap(NULL, size, native_flags, map_flags, file->filedes, offset);
 
     if (mm == (void *)-1) {
         /* we failed to get an mmap'd file... */
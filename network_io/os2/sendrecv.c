@@ -171,3 +171,19 @@ APR_DECLARE(apr_status_t) apr_socket_wait(apr_socket_t *sock, apr_wait_type_t di
 
     return APR_SUCCESS;
 }
+
+APR_DECLARE(apr_status_t) apr_socket_send_pipe(apr_socket_t *sock,
+                                               apr_file_t *pipe,
+                                               apr_size_t *len)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_socket_recv_pipe(apr_socket_t *sock,
+                                               apr_file_t *pipe,
+                                               apr_size_t *len)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
@@ -17,10 +17,14 @@
 #include "apr_arch_networkio.h"
 #include "apr_support.h"
 
-#if APR_HAS_SENDFILE
+#if APR_HAS_SENDFILE || defined(HAVE_SPLICE)
 /* This file is needed to allow us access to the apr_file_t internals. */
 #include "apr_arch_file_io.h"
-#endif /* APR_HAS_SENDFILE */
+#endif /* APR_HAS_SENDFILE || HAVE_SPLICE */
+
+#if defined(HAVE_SPLICE) && defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
 
 /* osreldate.h is only needed on FreeBSD for sendfile detection */
 #if defined(__FreeBSD__)
@@ -247,6 +251,149 @@ apr_status_t apr_socket_wait(apr_socket_t *sock, apr_wait_type_t direction)
     return apr_wait_for_io_or_timeout(NULL, sock, direction == APR_WAIT_READ);
 }
 
+#ifdef HAVE_SPLICE
+
+/* Whether the pipe can be read (not empty) or written (not full) without
+ * blocking, to tell which side of splice() would block: the events it is
+ * ready for (POLLHUP/POLLERR included), or 0.
+ */
+static short pipe_ready(apr_file_t *pipe, short events)
+{
+    struct pollfd pfd;
+    int rc;
+
+    pfd.fd = pipe->filedes;
+    pfd.events = events;
+    do {
+        rc = poll(&pfd, 1, 0);
+    } while (rc == -1 && errno == EINTR);
+
+    return rc > 0 ? pfd.revents : 0;
+}
+
+apr_status_t apr_socket_send_pipe(apr_socket_t *sock, apr_file_t *pipe,
+                                  apr_size_t *len)
+{
+    apr_ssize_t rv;
+
+    if (pipe->buffered || pipe->ungetchar != -1) {
+        /* Some data were already read from the descriptor */
+        *len = 0;
+        return APR_ENOTIMPL;
+    }
+
+    if (sock->options & APR_INCOMPLETE_WRITE) {
+        sock->options &= ~APR_INCOMPLETE_WRITE;
+        goto do_select;
+    }
+
+    do {
+        rv = splice(pipe->filedes, NULL, sock->socketdes, NULL, *len,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (rv == -1 && errno == EINTR);
+
+    while (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
+                     && sock->timeout > 0
+                     && pipe_ready(pipe, POLLIN)) {
+        apr_status_t arv;
+do_select:
+        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        if (arv != APR_SUCCESS) {
+            *len = 0;
+            return arv;
+        }
+        else {
+            do {
+                rv = splice(pipe->filedes, NULL, sock->socketdes, NULL, *len,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            } while (rv == -1 && errno == EINTR);
+        }
+    }
+    if (rv == -1) {
+        *len = 0;
+        return errno;
+    }
+    if (rv == 0) {
+        /* All the writers of the pipe are gone */
+        *len = 0;
+        return APR_EOF;
+    }
+    if (sock->timeout > 0 && rv < *len
+        && (pipe_ready(pipe, POLLIN) & POLLIN)) {
+        /* The pipe had more than the socket accepted (rather than
+         * running dry), so it's worth waiting for the socket next time.
+         */
+        sock->options |= APR_INCOMPLETE_WRITE;
+    }
+    *len = rv;
+    return APR_SUCCESS;
+}
+
+apr_status_t apr_socket_recv_pipe(apr_socket_t *sock, apr_file_t *pipe,
+                                  apr_size_t *len)
+{
+    apr_ssize_t rv;
+
+    if (sock->options & APR_INCOMPLETE_READ) {
+        sock->options &= ~APR_INCOMPLETE_READ;
+        goto do_select;
+    }
+
+    do {
+        rv = splice(sock->socketdes, NULL, pipe->filedes, NULL, *len,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (rv == -1 && errno == EINTR);
+
+    while (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
+                     && sock->timeout > 0
+                     && pipe_ready(pipe, POLLOUT)) {
+        apr_status_t arv;
+do_select:
+        arv = apr_wait_for_io_or_timeout(NULL, sock, 1);
+        if (arv != APR_SUCCESS) {
+            *len = 0;
+            return arv;
+        }
+        else {
+            do {
+                rv = splice(sock->socketdes, NULL, pipe->filedes, NULL, *len,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            } while (rv == -1 && errno == EINTR);
+        }
+    }
+    if (rv == -1) {
+        *len = 0;
+        return errno;
+    }
+    if (rv == 0) {
+        *len = 0;
+        return APR_EOF;
+    }
+    if (sock->timeout > 0 && rv < *len) {
+        sock->options |= APR_INCOMPLETE_READ;
+    }
+    *len = rv;
+    return APR_SUCCESS;
+}
+
+#else /* !HAVE_SPLICE */
+
+apr_status_t apr_socket_send_pipe(apr_socket_t *sock, apr_file_t *pipe,
+                                  apr_size_t *len)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
+
+apr_status_t apr_socket_recv_pipe(apr_socket_t *sock, apr_file_t *pipe,
+                                  apr_size_t *len)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
+
+#endif /* HAVE_SPLICE */
+
 #if APR_HAS_SENDFILE
 
 /* TODO: Verify that all platforms handle the fd the same way,
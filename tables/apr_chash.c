@@ -0,0 +1,215 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_thread_rwlock.h"
+
+#include "apr_hash.h"
+#include "apr_chash.h"
+
+/*
+ * The keys are spread over the shards by the high bits of their hash
+ * (mixed), while the apr_hash_t of each shard uses the low bits of its
+ * own (seeded) hash.
+ *
+ * Each shard has its own pool and allocator, and its lock is allocated
+ * from there too, so the locks of the different shards do not share
+ * cache lines, and the shards never contend for memory.
+ */
+
+#define DEFAULT_SHARDS  64
+#define MAX_SHARDS      65536
+
+typedef struct chash_shard_t {
+    apr_pool_t          *pool;
+    apr_hash_t          *hash;
+#if APR_HAS_THREADS
+    apr_thread_rwlock_t *lock;
+#endif
+} chash_shard_t;
+
+struct apr_chash_t {
+    apr_pool_t          *pool;
+    apr_hashfunc_t       hash_func;
+    chash_shard_t       *shards;
+    unsigned int         mask;
+};
+
+#if APR_HAS_THREADS
+#define shard_rdlock(shard) apr_thread_rwlock_rdlock((shard)->lock)
+#define shard_wrlock(shard) apr_thread_rwlock_wrlock((shard)->lock)
+#define shard_unlock(shard) apr_thread_rwlock_unlock((shard)->lock)
+#else
+#define shard_rdlock(shard)
+#define shard_wrlock(shard)
+#define shard_unlock(shard)
+#endif
+
+/* Also computes the length of string keys, once for all */
+static APR_INLINE chash_shard_t *chash_shard(apr_chash_t *ht,
+                                             const void *key,
+                                             apr_ssize_t *klen)
+{
+    unsigned int hash = ht->hash_func(key, klen);
+
+    return &ht->shards[((hash * 0x9E3779B1U) >> 16) & ht->mask];
+}
+
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **newht,
+                                           unsigned int shards,
+                                           apr_hashfunc_t hash_func,
+                                           apr_uint32_t flags,
+                                           apr_pool_t *pool)
+{
+    apr_chash_t *ht;
+    unsigned int n, i;
+    apr_status_t rv;
+
+    if (shards == 0)
+        shards = DEFAULT_SHARDS;
+    else if (shards > MAX_SHARDS)
+        shards = MAX_SHARDS;
+    for (n = 1; n < shards; n *= 2)
+        ;
+
+    ht = apr_palloc(pool, sizeof(apr_chash_t));
+    ht->pool = pool;
+    ht->hash_func = hash_func ? hash_func : apr_hashfunc_fast;
+    ht->mask = n - 1;
+    ht->shards = apr_pcalloc(pool, n * sizeof(chash_shard_t));
+
+    for (i = 0; i < n; i++) {
+        chash_shard_t *shard = &ht->shards[i];
+        apr_allocator_t *allocator;
+
+        if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+            return rv;
+        rv = apr_pool_create_ex(&shard->pool, pool, NULL, allocator);
+        if (rv != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+            return rv;
+        }
+        apr_allocator_owner_set(allocator, shard->pool);
+        apr_pool_tag(shard->pool, "apr_chash");
+
+#if APR_HAS_THREADS
+        rv = apr_thread_rwlock_create(&shard->lock, shard->pool);
+        if (rv != APR_SUCCESS)
+            return rv;
+#endif
+
+        if (hash_func)
+            shard->hash = apr_hash_make_custom_ex(shard->pool, hash_func,
+                                                  flags);
+        else
+            shard->hash = apr_hash_make_ex(shard->pool, flags);
+    }
+
+    *newht = ht;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_chash_set(apr_chash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val)
+{
+    chash_shard_t *shard = chash_shard(ht, key, &klen);
+
+    shard_wrlock(shard);
+    apr_hash_set(shard->hash, key, klen, val);
+    shard_unlock(shard);
+}
+
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+{
+    chash_shard_t *shard = chash_shard(ht, key, &klen);
+    void *val;
+
+    shard_rdlock(shard);
+    val = apr_hash_get(shard->hash, key, klen);
+    shard_unlock(shard);
+
+    return val;
+}
+
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val)
+{
+    chash_shard_t *shard = chash_shard(ht, key, &klen);
+    void *old;
+
+    /* most likely there already */
+    shard_rdlock(shard);
+    old = apr_hash_get(shard->hash, key, klen);
+    shard_unlock(shard);
+    if (old || !val)
+        return old;
+
+    shard_wrlock(shard);
+    old = apr_hash_get_or_set(shard->hash, key, klen, val);
+    shard_unlock(shard);
+
+    return old;
+}
+
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht)
+{
+    unsigned int i, count = 0;
+
+    for (i = 0; i <= ht->mask; i++) {
+        chash_shard_t *shard = &ht->shards[i];
+
+        shard_rdlock(shard);
+        count += apr_hash_count(shard->hash);
+        shard_unlock(shard);
+    }
+
+    return count;
+}
+
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht)
+{
+    unsigned int i;
+
+    for (i = 0; i <= ht->mask; i++) {
+        chash_shard_t *shard = &ht->shards[i];
+
+        shard_wrlock(shard);
+        apr_hash_clear(shard->hash);
+        shard_unlock(shard);
+    }
+}
+
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht)
+{
+    unsigned int i;
+    int rv = 1;
+
+    for (i = 0; i <= ht->mask && rv; i++) {
+        chash_shard_t *shard = &ht->shards[i];
+
+        shard_rdlock(shard);
+        rv = apr_hash_do(comp, rec, shard->hash);
+        shard_unlock(shard);
+    }
+
+    return rv;
+}
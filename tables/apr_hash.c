@@ -18,6 +18,7 @@
 
 #include "apr_general.h"
 #include "apr_pools.h"
+#include "apr_strings.h"
 #include "apr_time.h"
 
 #include "apr_hash.h"
@@ -33,6 +34,12 @@
 #include <stdio.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_FLAT_SSE2 1
+#endif
+
 /*
  * The internal form of a hash table.
  *
@@ -40,10 +47,25 @@
  * are resolved by hanging a linked list of hash entries off each
  * element of the array. Although this is a really simple design it
  * isn't too bad given that pools have a low allocation overhead.
+ *
+ * With APR_HASH_FLAT the entries are stored in the array itself (open
+ * addressing), and each one has a control byte telling whether it is
+ * empty, deleted, or full with the low 7 bits of its hash.  The control
+ * bytes are probed a group at a time, so a lookup mostly reads a few
+ * control bytes and the entry it is after.
+ *
+ * With APR_HASH_INCREMENTAL, the previous array is kept when expanding
+ * and its buckets are moved to the new one a few at a time on insertions
+ * (not on lookups or removals, so that iterating while removing or
+ * replacing entries remains safe).  The buckets of the new array are
+ * only initialized when the old bucket they come from is moved.
  */
 
 typedef struct apr_hash_entry_t apr_hash_entry_t;
 
+typedef unsigned int (*hashfunc_seeded_t)(const char *key, apr_ssize_t *klen,
+                                          unsigned int seed);
+
 struct apr_hash_entry_t {
     apr_hash_entry_t *next;
     unsigned int      hash;
@@ -78,10 +100,119 @@ struct apr_hash_t {
     apr_hash_index_t     iterator;  /* For apr_hash_first(NULL, ...) */
     unsigned int         count, max, seed;
     apr_hashfunc_t       hash_func;
+    hashfunc_seeded_t    hash_seeded;  /* Used if hash_func is NULL */
     apr_hash_entry_t    *free;  /* List of recycled entries */
+    /* Open addressing (APR_HASH_FLAT), the array is then NULL */
+    unsigned char       *ctrl;
+    apr_hash_entry_t    *slots;
+    unsigned int         growth;  /* Empty slots usable before rehashing */
+    unsigned char       *spare_ctrl;  /* Arrays of the same size, reused */
+    apr_hash_entry_t    *spare_slots; /* when rehashing without growing */
+    /* Incremental expansion (APR_HASH_INCREMENTAL) */
+    int                  incremental;
+    apr_hash_entry_t   **old_array;  /* NULL unless expanding */
+    unsigned int         old_max, rehash_index;
 };
 
+/* Number of old buckets moved per insertion while expanding, must be at
+ * least 1 for the expansion to be over before the next one.
+ */
+#define REHASH_STEPS 4
+
+#define FLAT_EMPTY      0x80
+#define FLAT_DELETED    0xFE
+#define FLAT_FULL(c)    (((c) & 0x80) == 0)
+#define FLAT_H1(hash)   ((hash) >> 7)
+#define FLAT_H2(hash)   ((unsigned char)((hash) & 0x7F))
+
+#ifdef HASH_FLAT_SSE2
+
+/* The mask of a group has one bit per slot */
+#define FLAT_GROUP      16
+#define FLAT_SHIFT      0
+
+typedef unsigned int flat_mask_t;
+
+static APR_INLINE flat_mask_t flat_match(const unsigned char *group,
+                                         unsigned char h2)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
+
+static APR_INLINE flat_mask_t flat_match_empty(const unsigned char *group)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,
+                                            _mm_set1_epi8((char)FLAT_EMPTY)));
+}
+
+/* Empty or deleted slots */
+static APR_INLINE flat_mask_t flat_match_free(const unsigned char *group)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else /* HASH_FLAT_SSE2 */
+
+/* The mask of a group has the high bit of each byte, for each slot.
+ * flat_match() may give false positives (following a true one, and
+ * always on full slots), it does not matter since keys are compared.
+ */
+#define FLAT_GROUP      8
+#define FLAT_SHIFT      3
+
+typedef apr_uint64_t flat_mask_t;
+
+#define FLAT_LSBS APR_UINT64_C(0x0101010101010101)
+#define FLAT_MSBS APR_UINT64_C(0x8080808080808080)
+
+static APR_INLINE apr_uint64_t flat_load(const unsigned char *group)
+{
+    return  (apr_uint64_t)group[0]        | (apr_uint64_t)group[1] << 8
+          | (apr_uint64_t)group[2] << 16  | (apr_uint64_t)group[3] << 24
+          | (apr_uint64_t)group[4] << 32  | (apr_uint64_t)group[5] << 40
+          | (apr_uint64_t)group[6] << 48  | (apr_uint64_t)group[7] << 56;
+}
+
+static APR_INLINE flat_mask_t flat_match(const unsigned char *group,
+                                         unsigned char h2)
+{
+    apr_uint64_t x = flat_load(group) ^ (FLAT_LSBS * h2);
+    return (x - FLAT_LSBS) & ~x & FLAT_MSBS;
+}
+
+static APR_INLINE flat_mask_t flat_match_empty(const unsigned char *group)
+{
+    apr_uint64_t w = flat_load(group);
+    return w & ~(w << 6) & FLAT_MSBS;
+}
+
+/* Empty or deleted slots */
+static APR_INLINE flat_mask_t flat_match_free(const unsigned char *group)
+{
+    return flat_load(group) & FLAT_MSBS;
+}
+
+#endif /* HASH_FLAT_SSE2 */
+
+/* Index in its group of the first slot of a (non-zero) mask */
+static APR_INLINE unsigned int flat_first(flat_mask_t m)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(m) >> FLAT_SHIFT;
+#else
+    unsigned int n = 0;
+    while (!(m & 1)) {
+        m >>= 1;
+        n++;
+    }
+    return n >> FLAT_SHIFT;
+#endif
+}
+
 #define INITIAL_MAX 15 /* tunable == 2^n - 1 */
+#define FLAT_INITIAL_SIZE (INITIAL_MAX + 1) /* at least FLAT_GROUP */
 
 
 /*
@@ -93,7 +224,27 @@ static apr_hash_entry_t **alloc_array(apr_hash_t *ht, unsigned int max)
    return apr_pcalloc(ht->pool, sizeof(*ht->array) * (max + 1));
 }
 
-APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+/* Up to 7/8 of the slots can be used (full or deleted), so that
+ * lookups always end on an empty slot.
+ */
+static void flat_alloc(apr_hash_t *ht, unsigned int size)
+{
+    ht->slots = apr_palloc(ht->pool, sizeof(*ht->slots) * size);
+    ht->ctrl = apr_palloc(ht->pool, size);
+    memset(ht->ctrl, FLAT_EMPTY, size);
+    ht->max = size - 1;
+    ht->growth = size - size / 8;
+}
+
+static unsigned int hashfunc_default(const char *char_key, apr_ssize_t *klen,
+                                     unsigned int hash);
+static unsigned int hashfunc_fast(const char *char_key, apr_ssize_t *klen,
+                                  unsigned int seed);
+
+/* Make a table of the layout given by flags, allocating only its own
+ * (chained or flat) arrays.
+ */
+static apr_hash_t *hash_make(apr_pool_t *pool, apr_uint32_t flags)
 {
     apr_hash_t *ht;
     apr_time_t now = apr_time_now();
@@ -102,15 +253,39 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
     ht->pool = pool;
     ht->free = NULL;
     ht->count = 0;
-    ht->max = INITIAL_MAX;
     ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
                               (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
-    ht->array = alloc_array(ht, ht->max);
     ht->hash_func = NULL;
+    ht->hash_seeded = (flags & APR_HASH_TIMES33) ? hashfunc_default
+                                                 : hashfunc_fast;
+    ht->spare_ctrl = NULL;
+    ht->spare_slots = NULL;
+    ht->incremental = 0;
+    ht->old_array = NULL;
+    ht->old_max = ht->rehash_index = 0;
+
+    if (flags & APR_HASH_FLAT) {
+        ht->array = NULL;
+        flat_alloc(ht, FLAT_INITIAL_SIZE);
+    }
+    else {
+        ht->max = INITIAL_MAX;
+        ht->array = alloc_array(ht, ht->max);
+        ht->ctrl = NULL;
+        ht->slots = NULL;
+        ht->growth = 0;
+        if (flags & APR_HASH_INCREMENTAL)
+            ht->incremental = 1;
+    }
 
     return ht;
 }
 
+APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+{
+    return hash_make(pool, 0);
+}
+
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
                                                apr_hashfunc_t hash_func)
 {
@@ -119,6 +294,21 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
     return ht;
 }
 
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_uint32_t flags)
+{
+    return hash_make(pool, flags);
+}
+
+APR_DECLARE(apr_hash_t *) apr_hash_make_custom_ex(apr_pool_t *pool,
+                                                  apr_hashfunc_t hash_func,
+                                                  apr_uint32_t flags)
+{
+    apr_hash_t *ht = apr_hash_make_ex(pool, flags);
+    ht->hash_func = hash_func;
+    return ht;
+}
+
 
 /*
  * Hash iteration functions.
@@ -126,12 +316,38 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
 
 APR_DECLARE(apr_hash_index_t *) apr_hash_next(apr_hash_index_t *hi)
 {
+    if (hi->ht->ctrl) {
+        while (hi->index <= hi->ht->max) {
+            unsigned int i = hi->index++;
+            if (FLAT_FULL(hi->ht->ctrl[i])) {
+                hi->this = &hi->ht->slots[i];
+                return hi;
+            }
+        }
+        return NULL;
+    }
+
     hi->this = hi->next;
     while (!hi->this) {
-        if (hi->index > hi->ht->max)
-            return NULL;
+        apr_hash_t *ht = hi->ht;
 
-        hi->this = hi->ht->array[hi->index++];
+        if (hi->index > ht->max) {
+            /* then the buckets not moved yet, if expanding */
+            unsigned int i = hi->index - (ht->max + 1);
+            if (!ht->old_array || i > ht->old_max)
+                return NULL;
+
+            hi->this = ht->old_array[i];
+            hi->index++;
+        }
+        else if (ht->old_array
+                 && (hi->index & ht->old_max) >= ht->rehash_index) {
+            /* not initialized yet */
+            hi->index++;
+        }
+        else {
+            hi->this = ht->array[hi->index++];
+        }
     }
     hi->next = hi->this->next;
     return hi;
@@ -190,12 +406,49 @@ APR_DECLARE(void *) apr_hash_this_val(apr_hash_index_t *hi)
  * Expanding a hash table
  */
 
+/* Move the next old buckets to the new array */
+static void rehash_step(apr_hash_t *ht, unsigned int steps)
+{
+    apr_hash_entry_t *he, *next;
+    unsigned int i, k;
+
+    while (steps-- && ht->rehash_index <= ht->old_max) {
+        k = ht->rehash_index++;
+        he = ht->old_array[k];
+        ht->old_array[k] = NULL;
+
+        /* the only two buckets this one goes to */
+        ht->array[k] = NULL;
+        ht->array[k + ht->old_max + 1] = NULL;
+        for (; he; he = next) {
+            next = he->next;
+            i = he->hash & ht->max;
+            he->next = ht->array[i];
+            ht->array[i] = he;
+        }
+    }
+    if (ht->rehash_index > ht->old_max)
+        ht->old_array = NULL;
+}
+
 static void expand_array(apr_hash_t *ht)
 {
     apr_hash_index_t *hi;
     apr_hash_entry_t **new_array;
     unsigned int new_max;
 
+    if (ht->incremental) {
+        while (ht->old_array)
+            rehash_step(ht, ht->old_max + 1);
+
+        ht->old_array = ht->array;
+        ht->old_max = ht->max;
+        ht->rehash_index = 0;
+        ht->max = ht->max * 2 + 1;
+        ht->array = apr_palloc(ht->pool, sizeof(*ht->array) * (ht->max + 1));
+        return;
+    }
+
     new_max = ht->max * 2 + 1;
     new_array = alloc_array(ht, new_max);
     for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi)) {
@@ -273,6 +526,120 @@ APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
     return hashfunc_default(char_key, klen, 0);
 }
 
+/*
+ * XXH64 by Yann Collet (BSD 2-Clause), with the result folded to an
+ * unsigned int.  The key is read eight bytes at a time, in four
+ * independent lanes for the long keys, so unlike "times 33" there is not
+ * a multiplication depending on the previous one for each byte.
+ */
+#define PRIME64_1 APR_UINT64_C(0x9E3779B185EBCA87)
+#define PRIME64_2 APR_UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 APR_UINT64_C(0x165667B19E3779F9)
+#define PRIME64_4 APR_UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME64_5 APR_UINT64_C(0x27D4EB2F165667C5)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static APR_INLINE apr_uint64_t read64(const unsigned char *p)
+{
+    apr_uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static APR_INLINE apr_uint32_t read32(const unsigned char *p)
+{
+    apr_uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static APR_INLINE apr_uint64_t xxh64_round(apr_uint64_t acc,
+                                           apr_uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static APR_INLINE apr_uint64_t xxh64_merge(apr_uint64_t acc,
+                                           apr_uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static unsigned int hashfunc_fast(const char *char_key, apr_ssize_t *klen,
+                                  unsigned int seed)
+{
+    const unsigned char *p = (const unsigned char *)char_key;
+    const unsigned char *end;
+    apr_uint64_t h;
+    apr_size_t len;
+
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(char_key);
+    }
+    len = *klen;
+    end = p + len;
+
+    if (len >= 32) {
+        const unsigned char *limit = end - 32;
+        apr_uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        apr_uint64_t v2 = seed + PRIME64_2;
+        apr_uint64_t v3 = seed;
+        apr_uint64_t v4 = seed - PRIME64_1;
+
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    }
+    else {
+        h = seed + PRIME64_5;
+    }
+    h += len;
+
+    while (p + 8 <= end) {
+        h ^= xxh64_round(0, read64(p));
+        h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (apr_uint64_t)read32(p) * PRIME64_1;
+        h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * PRIME64_5;
+        h = ROTL64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return (unsigned int)h;
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *char_key,
+                                                   apr_ssize_t *klen)
+{
+    return hashfunc_fast(char_key, klen, 0);
+}
+
 /*
  * This is where we keep the details of the hash function and control
  * the maximum collision rate.
@@ -293,11 +660,15 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     if (ht->hash_func)
         hash = ht->hash_func(key, &klen);
     else
-        hash = hashfunc_default(key, &klen, ht->seed);
+        hash = ht->hash_seeded(key, &klen, ht->seed);
+
+    if (ht->old_array && (hash & ht->old_max) >= ht->rehash_index)
+        hep = &ht->old_array[hash & ht->old_max];
+    else
+        hep = &ht->array[hash & ht->max];
 
     /* scan linked list */
-    for (hep = &ht->array[hash & ht->max], he = *hep;
-         he; hep = &he->next, he = *hep) {
+    for (he = *hep; he; hep = &he->next, he = *hep) {
         if (he->hash == hash
             && he->klen == klen
             && memcmp(he->key, key, klen) == 0)
@@ -321,6 +692,139 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     return hep;
 }
 
+/*
+ * Open addressing (APR_HASH_FLAT).
+ *
+ * The number of groups is a power of two.  A key is looked for in the
+ * group given by the high bits of its hash, then in the next groups of a
+ * triangular sequence (which visits them all) until one has an empty
+ * slot.
+ */
+
+static unsigned int flat_find_free(const apr_hash_t *ht, unsigned int hash)
+{
+    unsigned int gmask = ht->max / FLAT_GROUP;
+    unsigned int g = FLAT_H1(hash) & gmask, step = 0;
+    flat_mask_t m;
+
+    while (!(m = flat_match_free(ht->ctrl + g * FLAT_GROUP)))
+        g = (g + ++step) & gmask;
+
+    return g * FLAT_GROUP + flat_first(m);
+}
+
+/* Grow the table, or only drop the deleted slots if they are the ones
+ * using it up.
+ */
+static void flat_rehash(apr_hash_t *ht)
+{
+    unsigned char *ctrl = ht->ctrl;
+    apr_hash_entry_t *slots = ht->slots;
+    unsigned int i, j, size = ht->max + 1;
+
+    if (ht->count > size / 16 * 7) {
+        ht->spare_ctrl = NULL;
+        ht->spare_slots = NULL;
+        flat_alloc(ht, size * 2);
+    }
+    else {
+        if (ht->spare_ctrl) {
+            ht->ctrl = ht->spare_ctrl;
+            ht->slots = ht->spare_slots;
+            memset(ht->ctrl, FLAT_EMPTY, size);
+            ht->growth = size - size / 8;
+        }
+        else {
+            flat_alloc(ht, size);
+        }
+        ht->spare_ctrl = ctrl;
+        ht->spare_slots = slots;
+    }
+
+    for (i = 0; i < size; i++) {
+        if (FLAT_FULL(ctrl[i])) {
+            j = flat_find_free(ht, slots[i].hash);
+            ht->ctrl[j] = ctrl[i];
+            ht->slots[j] = slots[i];
+        }
+    }
+    ht->growth -= ht->count;
+}
+
+/*
+ * The find_entry() of open addressing, it returns the entry itself
+ * (or NULL).
+ */
+static apr_hash_entry_t *flat_entry(apr_hash_t *ht,
+                                    const void *key,
+                                    apr_ssize_t klen,
+                                    const void *val)
+{
+    const unsigned char *group;
+    apr_hash_entry_t *he;
+    unsigned int hash, gmask, g, i, step = 0;
+    unsigned char h2;
+    flat_mask_t m;
+
+    if (ht->hash_func)
+        hash = ht->hash_func(key, &klen);
+    else
+        hash = ht->hash_seeded(key, &klen, ht->seed);
+    h2 = FLAT_H2(hash);
+
+    /* probe the groups */
+    gmask = ht->max / FLAT_GROUP;
+    g = FLAT_H1(hash) & gmask;
+    for (;;) {
+        group = ht->ctrl + g * FLAT_GROUP;
+        for (m = flat_match(group, h2); m; m &= m - 1) {
+            he = &ht->slots[g * FLAT_GROUP + flat_first(m)];
+            if (he->hash == hash
+                && he->klen == klen
+                && memcmp(he->key, key, klen) == 0)
+                return he;
+        }
+        if (flat_match_empty(group))
+            break;
+        g = (g + ++step) & gmask;
+    }
+    if (!val)
+        return NULL;
+
+    /* add a new entry for non-NULL values */
+    if (ht->growth == 0)
+        flat_rehash(ht);
+    i = flat_find_free(ht, hash);
+    if (ht->ctrl[i] == FLAT_EMPTY)
+        ht->growth--;
+    ht->ctrl[i] = h2;
+    he = &ht->slots[i];
+    he->next = NULL;
+    he->hash = hash;
+    he->key  = key;
+    he->klen = klen;
+    he->val  = val;
+    ht->count++;
+    return he;
+}
+
+static void flat_remove(apr_hash_t *ht, apr_hash_entry_t *he)
+{
+    unsigned int i = he - ht->slots;
+
+    /* Lookups stop at a group with an empty slot anyway, so the slot can
+     * be emptied rather than deleted.
+     */
+    if (flat_match_empty(ht->ctrl + (i & ~(FLAT_GROUP - 1)))) {
+        ht->ctrl[i] = FLAT_EMPTY;
+        ht->growth++;
+    }
+    else {
+        ht->ctrl[i] = FLAT_DELETED;
+    }
+    --ht->count;
+}
+
 APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
                                         const apr_hash_t *orig)
 {
@@ -328,6 +832,17 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     apr_hash_entry_t *new_vals;
     unsigned int i, j;
 
+    if (orig->ctrl) {
+        ht = apr_pmemdup(pool, orig, sizeof(apr_hash_t));
+        ht->pool = pool;
+        ht->slots = apr_pmemdup(pool, orig->slots,
+                                sizeof(*ht->slots) * (orig->max + 1));
+        ht->ctrl = apr_pmemdup(pool, orig->ctrl, orig->max + 1);
+        ht->spare_ctrl = NULL;
+        ht->spare_slots = NULL;
+        return ht;
+    }
+
     ht = apr_palloc(pool, sizeof(apr_hash_t) +
                     sizeof(*ht->array) * (orig->max + 1) +
                     sizeof(apr_hash_entry_t) * orig->count);
@@ -337,11 +852,41 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     ht->max = orig->max;
     ht->seed = orig->seed;
     ht->hash_func = orig->hash_func;
+    ht->hash_seeded = orig->hash_seeded;
     ht->array = (apr_hash_entry_t **)((char *)ht + sizeof(apr_hash_t));
+    ht->ctrl = NULL;
+    ht->slots = NULL;
+    ht->growth = 0;
+    ht->spare_ctrl = NULL;
+    ht->spare_slots = NULL;
+    ht->incremental = orig->incremental;
+    ht->old_array = NULL;
+    ht->old_max = ht->rehash_index = 0;
 
     new_vals = (apr_hash_entry_t *)((char *)(ht) + sizeof(apr_hash_t) +
                                     sizeof(*ht->array) * (orig->max + 1));
     j = 0;
+    if (orig->old_array) {
+        /* expanding, rehash all the entries in the new array */
+        apr_hash_index_t hix, *hi;
+
+        memset(ht->array, 0, sizeof(*ht->array) * (ht->max + 1));
+        hix.ht    = (apr_hash_t *)orig;
+        hix.index = 0;
+        hix.this  = NULL;
+        hix.next  = NULL;
+        for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+            apr_hash_entry_t *new_entry = &new_vals[j++];
+            i = hi->this->hash & ht->max;
+            new_entry->hash = hi->this->hash;
+            new_entry->key = hi->this->key;
+            new_entry->klen = hi->this->klen;
+            new_entry->val = hi->this->val;
+            new_entry->next = ht->array[i];
+            ht->array[i] = new_entry;
+        }
+        return ht;
+    }
     for (i = 0; i <= ht->max; i++) {
         apr_hash_entry_t **new_entry = &(ht->array[i]);
         apr_hash_entry_t *orig_entry = orig->array[i];
@@ -364,7 +909,10 @@ APR_DECLARE(void *) apr_hash_get(apr_hash_t *ht,
                                  apr_ssize_t klen)
 {
     apr_hash_entry_t *he;
-    he = *find_entry(ht, key, klen, NULL);
+    if (ht->ctrl)
+        he = flat_entry(ht, key, klen, NULL);
+    else
+        he = *find_entry(ht, key, klen, NULL);
     if (he)
         return (void *)he->val;
     else
@@ -377,6 +925,20 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
                                const void *val)
 {
     apr_hash_entry_t **hep;
+    unsigned int count;
+
+    if (ht->ctrl) {
+        apr_hash_entry_t *he = flat_entry(ht, key, klen, val);
+        if (he) {
+            if (val)
+                he->val = val;
+            else
+                flat_remove(ht, he);
+        }
+        return;
+    }
+
+    count = ht->count;
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         if (!val) {
@@ -394,6 +956,10 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
             if (ht->count > ht->max) {
                 expand_array(ht);
             }
+            else if (ht->old_array && ht->count > count) {
+                /* added entry, move on with the expansion */
+                rehash_step(ht, REHASH_STEPS);
+            }
         }
     }
     /* else key not present and val==NULL */
@@ -405,6 +971,14 @@ APR_DECLARE(void *) apr_hash_get_or_set(apr_hash_t *ht,
                                         const void *val)
 {
     apr_hash_entry_t **hep;
+    unsigned int count;
+
+    if (ht->ctrl) {
+        apr_hash_entry_t *he = flat_entry(ht, key, klen, val);
+        return he ? (void *)he->val : NULL;
+    }
+
+    count = ht->count;
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         val = (*hep)->val;
@@ -412,6 +986,10 @@ APR_DECLARE(void *) apr_hash_get_or_set(apr_hash_t *ht,
         if (ht->count > ht->max) {
             expand_array(ht);
         }
+        else if (ht->old_array && ht->count > count) {
+            /* added entry, move on with the expansion */
+            rehash_step(ht, REHASH_STEPS);
+        }
         return (void *)val;
     }
     /* else key not present and val==NULL */
@@ -426,6 +1004,14 @@ APR_DECLARE(unsigned int) apr_hash_count(apr_hash_t *ht)
 APR_DECLARE(void) apr_hash_clear(apr_hash_t *ht)
 {
     apr_hash_index_t *hi;
+
+    if (ht->ctrl) {
+        memset(ht->ctrl, FLAT_EMPTY, ht->max + 1);
+        ht->growth = (ht->max + 1) - (ht->max + 1) / 8;
+        ht->count = 0;
+        return;
+    }
+
     for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi))
         apr_hash_set(ht, hi->this->key, hi->this->klen, NULL);
 }
@@ -471,10 +1057,35 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
 #endif
 
+    if (base->ctrl || overlay->ctrl || base->old_array || overlay->old_array) {
+        apr_hash_index_t hix, *hi;
+        const void *val;
+
+        res = apr_hash_copy(p, base);
+
+        hix.ht    = (apr_hash_t *)overlay;
+        hix.index = 0;
+        hix.this  = NULL;
+        hix.next  = NULL;
+        for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+            iter = hi->this;
+            val = iter->val;
+            if (merger) {
+                const void *h2_val = apr_hash_get(res, iter->key, iter->klen);
+                if (h2_val)
+                    val = (*merger)(p, iter->key, iter->klen,
+                                    iter->val, h2_val, data);
+            }
+            apr_hash_set(res, iter->key, iter->klen, val);
+        }
+        return res;
+    }
+
     res = apr_palloc(p, sizeof(apr_hash_t));
     res->pool = p;
     res->free = NULL;
     res->hash_func = base->hash_func;
+    res->hash_seeded = base->hash_seeded;
     res->count = base->count;
     res->max = (overlay->max > base->max) ? overlay->max : base->max;
     if (base->count + overlay->count > res->max) {
@@ -482,6 +1093,14 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
     res->seed = base->seed;
     res->array = alloc_array(res, res->max);
+    res->ctrl = NULL;
+    res->slots = NULL;
+    res->growth = 0;
+    res->spare_ctrl = NULL;
+    res->spare_slots = NULL;
+    res->incremental = base->incremental;
+    res->old_array = NULL;
+    res->old_max = res->rehash_index = 0;
     if (base->count + overlay->count) {
         new_vals = apr_palloc(p, sizeof(apr_hash_entry_t) *
                               (base->count + overlay->count));
@@ -505,7 +1124,7 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
             if (res->hash_func)
                 hash = res->hash_func(iter->key, &iter->klen);
             else
-                hash = hashfunc_default(iter->key, &iter->klen, res->seed);
+                hash = res->hash_seeded(iter->key, &iter->klen, res->seed);
             i = hash & res->max;
             for (ent = res->array[i]; ent; ent = ent->next) {
                 if ((ent->klen == iter->klen) &&
@@ -24,6 +24,7 @@
  */
 
 #include "apr_skiplist.h"
+#include "apr_slab.h"
 
 typedef struct {
     apr_skiplistnode **data;
@@ -73,56 +74,49 @@ static int get_b_rand(void)
 
 typedef struct {
     size_t size;
-    apr_array_header_t *list;
+    apr_slab_t *slab;
 } memlist_t;
 
-typedef struct {
-    void *ptr;
-    char inuse;
-} chunk_t;
+/* Each chunk is prefixed with the object cache it comes from, so that
+ * apr_skiplist_free() finds it without searching the chunks.  Once freed,
+ * this word holds the cache's free-list link instead (another chunk or
+ * NULL), which never equals a cache, so a second free is ignored.
+ */
+#define CHUNK_HDR_SIZE APR_ALIGN_DEFAULT(sizeof(apr_slab_t *))
 
 APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size)
 {
     if (sl->pool) {
-        void *ptr;
-        int found_size = 0;
-        int i;
-        chunk_t *newchunk;
+        apr_slab_t **chunk;
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
+        int i;
+
         for (i = 0; i < sl->memlist->nelts; i++) {
             if (memlist->size == size) {
-                int j;
-                chunk_t *chunk = (chunk_t *)memlist->list->elts;
-                found_size = 1;
-                for (j = 0; j < memlist->list->nelts; j++) {
-                    if (!chunk->inuse) {
-                        chunk->inuse = 1;
-                        return chunk->ptr;
-                    }
-                    chunk++;
-                }
-                break; /* no free of this size; punt */
+                break;
             }
             memlist++;
         }
-        /* no free chunks */
-        ptr = apr_palloc(sl->pool, size);
-        if (!ptr) {
-            return ptr;
-        }
         /*
          * is this a new sized chunk? If so, we need to create a new
-         * array of them. Otherwise, re-use what we already have.
+         * cache for them. Otherwise, re-use what we already have.
          */
-        if (!found_size) {
+        if (i == sl->memlist->nelts) {
+            apr_slab_t *slab;
+            if (apr_slab_create(&slab, CHUNK_HDR_SIZE + size, 0,
+                                sl->pool) != APR_SUCCESS) {
+                return NULL;
+            }
             memlist = apr_array_push(sl->memlist);
             memlist->size = size;
-            memlist->list = apr_array_make(sl->pool, 20, sizeof(chunk_t));
+            memlist->slab = slab;
+        }
+        chunk = apr_slab_alloc(memlist->slab);
+        if (!chunk) {
+            return NULL;
         }
-        newchunk = apr_array_push(memlist->list);
-        newchunk->ptr = ptr;
-        newchunk->inuse = 1;
-        return ptr;
+        *chunk = memlist->slab;
+        return (char *)chunk + CHUNK_HDR_SIZE;
     }
     else {
         return malloc(size);
@@ -134,18 +128,16 @@ APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
     if (!sl->pool) {
         free(mem);
     }
-    else {
-        int i;
+    else if (mem) {
+        apr_slab_t **chunk = (apr_slab_t **)((char *)mem - CHUNK_HDR_SIZE);
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
+        int i;
+
+        /* Ignore the memory not allocated here, or freed already */
         for (i = 0; i < sl->memlist->nelts; i++) {
-            int j;
-            chunk_t *chunk = (chunk_t *)memlist->list->elts;
-            for (j = 0; j < memlist->list->nelts; j++) {
-                if (chunk->ptr == mem) {
-                    chunk->inuse = 0;
-                    return;
-                }
-                chunk++;
+            if (memlist->slab == *chunk) {
+                apr_slab_free(memlist->slab, chunk);
+                return;
             }
             memlist++;
         }
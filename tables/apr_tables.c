@@ -110,9 +110,10 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
         int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
         char *new_data;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+        new_data = apr_palloc_grow(arr->pool, arr->elts,
+                                   arr->nalloc * arr->elt_size,
+                                   arr->elt_size * new_size);
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
         memset(new_data + arr->nalloc * arr->elt_size, 0,
                arr->elt_size * (new_size - arr->nalloc));
         arr->elts = new_data;
@@ -129,9 +130,10 @@ static void *apr_array_push_noclear(apr_array_header_t *arr)
         int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
         char *new_data;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+        new_data = apr_palloc_grow(arr->pool, arr->elts,
+                                   arr->nalloc * arr->elt_size,
+                                   arr->elt_size * new_size);
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
         arr->elts = new_data;
         arr->nalloc = new_size;
     }
@@ -153,8 +155,11 @@ APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 	    new_size *= 2;
 	}
 
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
+	new_data = apr_palloc_grow(dst->pool, dst->elts,
+	                           dst->nalloc * elt_size,
+	                           elt_size * new_size);
+	memset(new_data + dst->nalloc * elt_size, 0,
+	       elt_size * (new_size - dst->nalloc));
 
 	dst->elts = new_data;
 	dst->nalloc = new_size;
@@ -184,6 +189,10 @@ APR_DECLARE(apr_array_header_t *) apr_array_copy(apr_pool_t *p,
  * It's useful when the elements of the array being copied are
  * read only, but new stuff *might* get added on the end; we have the
  * overhead of the full copy only where it is really needed.
+ *
+ * Note that apr_palloc_grow() keeps the shared data section valid when
+ * it moves the elements of either array, and extending it in place only
+ * touches the elements past the ones of the copy (res->nalloc).
  */
 
 static APR_INLINE void copy_array_hdr_core(apr_array_header_t *res,
@@ -299,6 +308,9 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 #define TABLE_INDEX_IS_INITIALIZED(t, i) ((t)->index_initialized & (1 << (i)))
 #define TABLE_SET_INDEX_INITIALIZED(t, i) ((t)->index_initialized |= (1 << (i)))
 
+/* Number of elements above which a table gets a hashed index too */
+#define TABLE_HASH_THRESHOLD 64
+
 /* Compute the "checksum" for a key, consisting of the first
  * 4 bytes, normalized for case-insensitivity and packed into
  * an int...this checksum allows us to do a single integer
@@ -355,6 +367,20 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* With many entries, the above index is not selective enough, so
+     * there is a hashed index of the whole (case-insensitive) keys too:
+     *   - hash_first[bucket] and hash_last[bucket] are the offsets of the
+     *     first and last entries of the bucket, or -1
+     *   - hash_next[i] is the offset of the next entry of the bucket of
+     *     the i'th entry, or -1
+     * The entries of a bucket are linked in table order.  hash_size is
+     * zero until the table grows past TABLE_HASH_THRESHOLD elements.
+     */
+    int hash_size;
+    int hash_nalloc;
+    int *hash_first;
+    int *hash_last;
+    int *hash_next;
 };
 
 /* keep state for apr_table_getm() */
@@ -387,6 +413,103 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+static APR_INLINE int table_hash_bucket(const apr_table_t *t,
+                                        const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    unsigned int hash = 0;
+
+    for (; *k; k++) {
+        hash = hash * 33 + apr_tolower(*k);
+    }
+    return (int)((hash ^ (hash >> 15)) & (t->hash_size - 1));
+}
+
+static APR_INLINE void table_hash_link(apr_table_t *t, int i)
+{
+    apr_table_entry_t *elt = ((apr_table_entry_t *) t->a.elts) + i;
+    int bucket;
+
+    t->hash_next[i] = -1;
+    if (!elt->key) {
+        return;
+    }
+    bucket = table_hash_bucket(t, elt->key);
+    if (t->hash_first[bucket] < 0) {
+        t->hash_first[bucket] = i;
+    }
+    else {
+        t->hash_next[t->hash_last[bucket]] = i;
+    }
+    t->hash_last[bucket] = i;
+}
+
+/* (Re)build the hashed index, with at least a bucket per element */
+static void table_hash_build(apr_table_t *t)
+{
+    int size, i;
+
+    for (size = TABLE_HASH_THRESHOLD * 2; size < t->a.nelts; size *= 2)
+        ;
+    if (size > t->hash_size) {
+        t->hash_first = apr_palloc(t->a.pool, size * sizeof(int));
+        t->hash_last = apr_palloc(t->a.pool, size * sizeof(int));
+        t->hash_size = size;
+    }
+    if (t->hash_nalloc < t->a.nalloc) {
+        t->hash_next = apr_palloc(t->a.pool, t->a.nalloc * sizeof(int));
+        t->hash_nalloc = t->a.nalloc;
+    }
+
+    memset(t->hash_first, -1, t->hash_size * sizeof(int));
+    for (i = 0; i < t->a.nelts; i++) {
+        table_hash_link(t, i);
+    }
+}
+
+/* Index the element just pushed */
+static void table_hash_push(apr_table_t *t)
+{
+    if (t->a.nelts > t->hash_size) {
+        if (t->hash_size || t->a.nelts > TABLE_HASH_THRESHOLD) {
+            table_hash_build(t);
+        }
+        return;
+    }
+    if (t->hash_nalloc < t->a.nalloc) {
+        int *next = apr_palloc(t->a.pool, t->a.nalloc * sizeof(int));
+        memcpy(next, t->hash_next, t->hash_nalloc * sizeof(int));
+        t->hash_next = next;
+        t->hash_nalloc = t->a.nalloc;
+    }
+    table_hash_link(t, t->a.nelts - 1);
+}
+
+/* Offset of the first entry with the key (or -1), and of the last one
+ * in *last if not NULL
+ */
+static int table_hash_find(const apr_table_t *t, const char *key,
+                           apr_uint32_t checksum, int *last)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *) t->a.elts;
+    int i, first = -1;
+
+    for (i = t->hash_first[table_hash_bucket(t, key)]; i >= 0;
+         i = t->hash_next[i]) {
+        if ((checksum == elts[i].key_checksum) &&
+            !strcasecmp(elts[i].key, key)) {
+            if (first < 0) {
+                first = i;
+                if (!last) {
+                    break;
+                }
+            }
+            *last = i;
+        }
+    }
+    return first;
+}
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,6 +529,8 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->hash_size = 0;
+    t->hash_nalloc = 0;
     return t;
 }
 
@@ -428,6 +553,11 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    new->hash_size = 0;
+    new->hash_nalloc = 0;
+    if (t->hash_size) {
+        table_hash_build(new);
+    }
     return new;
 }
 
@@ -460,12 +590,18 @@ static void table_reindex(apr_table_t *t)
             TABLE_SET_INDEX_INITIALIZED(t, hash);
         }
     }
+    if (t->hash_size || t->a.nelts > TABLE_HASH_THRESHOLD) {
+        table_hash_build(t);
+    }
 }
 
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
     t->a.nelts = 0;
     t->index_initialized = 0;
+    if (t->hash_size) {
+        memset(t->hash_first, -1, t->hash_size * sizeof(int));
+    }
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -484,6 +620,10 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
         return NULL;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    if (t->hash_size) {
+        int i = table_hash_find(t, key, checksum, NULL);
+        return (i < 0) ? NULL : ((apr_table_entry_t *) t->a.elts)[i].val;
+    }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
@@ -516,6 +656,15 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
+    if (t->hash_size) {
+        /* Only from the first to the last entry with this key */
+        int first, last;
+        if ((first = table_hash_find(t, key, checksum, &last)) < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+        end_elt = ((apr_table_entry_t *) t->a.elts) + last;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -567,6 +716,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
@@ -588,6 +738,15 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
+    if (t->hash_size) {
+        /* Only from the first to the last entry with this key */
+        int first, last;
+        if ((first = table_hash_find(t, key, checksum, &last)) < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+        end_elt = ((apr_table_entry_t *) t->a.elts) + last;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -639,6 +798,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -657,6 +817,15 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     COMPUTE_KEY_CHECKSUM(key, checksum);
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->hash_size) {
+        /* Only from the first to the last entry with this key */
+        int first, last;
+        if ((first = table_hash_find(t, key, checksum, &last)) < 0) {
+            return;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+        end_elt = ((apr_table_entry_t *) t->a.elts) + last;
+    }
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -712,6 +881,13 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->hash_size) {
+        int first = table_hash_find(t, key, checksum, NULL);
+        if (first < 0) {
+            goto add_new_elt;
+        }
+        next_elt = end_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -730,6 +906,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -767,6 +944,13 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->hash_size) {
+        int first = table_hash_find(t, key, checksum, NULL);
+        if (first < 0) {
+            goto add_new_elt;
+        }
+        next_elt = end_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -785,6 +969,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
@@ -805,6 +990,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
@@ -838,6 +1024,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_hash_push(t);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,6 +1055,8 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    res->hash_size = 0;
+    res->hash_nalloc = 0;
     table_reindex(res);
     return res;
 }
@@ -971,7 +1160,18 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
         if (argp) {
             /* Scan for entries that match the next key */
             int hash = TABLE_HASH(argp);
-            if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
+            if (TABLE_INDEX_IS_INITIALIZED(t, hash) && t->hash_size) {
+                apr_uint32_t checksum;
+                COMPUTE_KEY_CHECKSUM(argp, checksum);
+                for (i = table_hash_find(t, argp, checksum, NULL);
+                     rv && (i >= 0); i = t->hash_next[i]) {
+                    if ((checksum == elts[i].key_checksum) &&
+                        !strcasecmp(elts[i].key, argp)) {
+                        rv = (*comp) (rec, elts[i].key, elts[i].val);
+                    }
+                }
+            }
+            else if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
                 apr_uint32_t checksum;
                 COMPUTE_KEY_CHECKSUM(argp, checksum);
                 for (i = t->index_first[hash];
@@ -1215,19 +1415,23 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
         t->index_initialized = s->index_initialized;
-        return;
     }
-
-    for (idx = 0; idx < TABLE_HASH_SIZE; ++idx) {
-        if (TABLE_INDEX_IS_INITIALIZED(s, idx)) {
-            t->index_last[idx] = s->index_last[idx] + n;
-            if (!TABLE_INDEX_IS_INITIALIZED(t, idx)) {
-                t->index_first[idx] = s->index_first[idx] + n;
+    else {
+        for (idx = 0; idx < TABLE_HASH_SIZE; ++idx) {
+            if (TABLE_INDEX_IS_INITIALIZED(s, idx)) {
+                t->index_last[idx] = s->index_last[idx] + n;
+                if (!TABLE_INDEX_IS_INITIALIZED(t, idx)) {
+                    t->index_first[idx] = s->index_first[idx] + n;
+                }
             }
         }
+
+        t->index_initialized |= s->index_initialized;
     }
 
-    t->index_initialized |= s->index_initialized;
+    if (t->hash_size || t->a.nelts > TABLE_HASH_THRESHOLD) {
+        table_hash_build(t);
+    }
 }
 
 APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
@@ -0,0 +1,314 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* hashperf.c
+ * This program compares the hash functions and layouts available to
+ * apr_hash_t on a few realistic key sets: it times insertion (and the
+ * slowest one) and lookups, and prints the distribution of the chain
+ * lengths each function gives.
+ * With threads, it also compares the throughput of an apr_hash_t behind
+ * a read/write lock with the one of an apr_chash_t, for 90% lookups.
+ *
+ * To run,
+ *
+ *   ./hashperf [-n keys] [-l lookup rounds] [-t threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>  /* for atexit() */
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_chash.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_rwlock.h"
+#include "apr_time.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#define MAX_CHAIN 8
+
+static int nkeys = 100000;
+static int rounds = 10;
+static int nthreads = 0;
+
+typedef const char *(*keygen_t)(apr_pool_t *p, int i);
+
+static const char *path_key(apr_pool_t *p, int i)
+{
+    return apr_psprintf(p, "/var/www/site%d/images/img%05d.png",
+                        i % 97, i);
+}
+
+static const char *header_key(apr_pool_t *p, int i)
+{
+    static const char *const names[] = {
+        "Accept", "Accept-Encoding", "Content-Type", "Content-Length",
+        "X-Forwarded-For", "X-Request-Id", "Cookie", "User-Agent"
+    };
+    return apr_psprintf(p, "%s-%x", names[i % 8], i);
+}
+
+static const char *number_key(apr_pool_t *p, int i)
+{
+    return apr_itoa(p, i);
+}
+
+static struct {
+    const char *name;
+    keygen_t gen;
+} keysets[] = {
+    { "paths", path_key },
+    { "headers", header_key },
+    { "numbers", number_key },
+};
+
+static struct {
+    const char *name;
+    apr_hashfunc_t func;
+    apr_uint32_t flags;
+} funcs[] = {
+    { "fast", apr_hashfunc_fast, 0 },
+    { "times33", apr_hashfunc_default, APR_HASH_TIMES33 },
+    { "fast, flat", apr_hashfunc_fast, APR_HASH_FLAT },
+    { "fast, incremental", apr_hashfunc_fast, APR_HASH_INCREMENTAL },
+};
+
+static void chains(const char **keys, apr_hashfunc_t func, apr_pool_t *p)
+{
+    unsigned int *counts, max, mask, i;
+    int hist[MAX_CHAIN];
+    apr_ssize_t len;
+
+    for (mask = 15; mask < (unsigned int)nkeys; mask = mask * 2 + 1)
+        ;
+    counts = apr_pcalloc(p, (mask + 1) * sizeof(*counts));
+
+    for (i = 0; i < (unsigned int)nkeys; i++) {
+        len = APR_HASH_KEY_STRING;
+        counts[func(keys[i], &len) & mask]++;
+    }
+
+    memset(hist, 0, sizeof hist);
+    for (max = 0, i = 0; i <= mask; i++) {
+        hist[counts[i] < MAX_CHAIN ? counts[i] : MAX_CHAIN - 1]++;
+        if (counts[i] > max)
+            max = counts[i];
+    }
+
+    printf("    chains:");
+    for (i = 0; i < MAX_CHAIN; i++)
+        printf(" %u%s=%d", i, i == MAX_CHAIN - 1 ? "+" : "", hist[i]);
+    printf(" max=%u\n", max);
+}
+
+static void timing(const char **keys, apr_uint32_t flags, apr_pool_t *p)
+{
+    apr_hash_t *h;
+    apr_time_t start, now, insert, worst = 0, lookup;
+    int i, r, found = 0;
+
+    start = now = apr_time_now();
+    h = apr_hash_make_ex(p, flags);
+    for (i = 0; i < nkeys; i++) {
+        apr_time_t prev = now;
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        now = apr_time_now();
+        if (now - prev > worst)
+            worst = now - prev;
+    }
+    insert = now - start;
+
+    start = apr_time_now();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < nkeys; i++) {
+            if (apr_hash_get(h, keys[i], APR_HASH_KEY_STRING))
+                found++;
+        }
+    }
+    lookup = apr_time_now() - start;
+
+    printf("    insert: %" APR_TIME_T_FMT " us (worst %" APR_TIME_T_FMT
+           " us), lookup: %" APR_TIME_T_FMT " us (%.1f Mlookups/s)%s\n",
+           insert, worst, lookup,
+           lookup ? (double)nkeys * rounds / lookup : 0.0,
+           found == nkeys * rounds ? "" : " MISSING KEYS");
+}
+
+#if APR_HAS_THREADS
+
+static struct {
+    const char **keys;
+    apr_hash_t *hash;
+    apr_thread_rwlock_t *lock;
+    apr_chash_t *chash;
+} shared;
+
+static void * APR_THREAD_FUNC locked_thread(apr_thread_t *thd, void *data)
+{
+    int i, r, n = *(int *)data;
+
+    for (r = 0; r < rounds; r++) {
+        for (i = n; i < nkeys; i += nthreads) {
+            if (i % 10) {
+                apr_thread_rwlock_rdlock(shared.lock);
+                apr_hash_get(shared.hash, shared.keys[i], APR_HASH_KEY_STRING);
+            }
+            else {
+                apr_thread_rwlock_wrlock(shared.lock);
+                apr_hash_set(shared.hash, shared.keys[i], APR_HASH_KEY_STRING,
+                             shared.keys[i]);
+            }
+            apr_thread_rwlock_unlock(shared.lock);
+        }
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC chash_thread(apr_thread_t *thd, void *data)
+{
+    int i, r, n = *(int *)data;
+
+    for (r = 0; r < rounds; r++) {
+        for (i = n; i < nkeys; i += nthreads) {
+            if (i % 10)
+                apr_chash_get(shared.chash, shared.keys[i],
+                              APR_HASH_KEY_STRING);
+            else
+                apr_chash_set(shared.chash, shared.keys[i],
+                              APR_HASH_KEY_STRING, shared.keys[i]);
+        }
+    }
+    return NULL;
+}
+
+static void concurrent(const char **keys, apr_pool_t *p)
+{
+    apr_thread_start_t funcs[2] = { locked_thread, chash_thread };
+    const char *names[2] = { "rwlock", "chash" };
+    apr_thread_t **threads;
+    apr_status_t rv;
+    apr_time_t start, elapsed;
+    int *ids, f, i;
+
+    threads = apr_palloc(p, nthreads * sizeof(*threads));
+    ids = apr_palloc(p, nthreads * sizeof(*ids));
+
+    shared.keys = keys;
+    shared.hash = apr_hash_make(p);
+    apr_thread_rwlock_create(&shared.lock, p);
+    apr_chash_create(&shared.chash, 0, NULL, 0, p);
+    for (i = 0; i < nkeys; i++) {
+        apr_hash_set(shared.hash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        apr_chash_set(shared.chash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+
+    for (f = 0; f < 2; f++) {
+        start = apr_time_now();
+        for (i = 0; i < nthreads; i++) {
+            ids[i] = i;
+            apr_thread_create(&threads[i], NULL, funcs[f], &ids[i], p);
+        }
+        for (i = 0; i < nthreads; i++)
+            apr_thread_join(&rv, threads[i]);
+        elapsed = apr_time_now() - start;
+
+        printf("    %d threads, %s: %" APR_TIME_T_FMT " us"
+               " (%.1f Mops/s)\n", nthreads, names[f], elapsed,
+               elapsed ? (double)nkeys * rounds / elapsed : 0.0);
+    }
+}
+
+#endif /* APR_HAS_THREADS */
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool, *sub;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    const char *optarg;
+    const char **keys;
+    char optchar;
+    char errmsg[200];
+    int s, f, i;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:l:t:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'n') {
+            nkeys = atoi(optarg);
+        }
+        else if (optchar == 'l') {
+            rounds = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            nthreads = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+    if (nkeys <= 0 || rounds <= 0 || nthreads < 0) {
+        fprintf(stderr, "Usage: %s [-n keys] [-l lookup rounds] "
+                "[-t threads]\n", argv[0]);
+        exit(-1);
+    }
+
+    printf("APR Hash Performance Test\n=========================\n\n");
+    printf("%d keys, %d lookup rounds\n\n", nkeys, rounds);
+
+    for (s = 0; s < sizeof(keysets) / sizeof(keysets[0]); s++) {
+        apr_pool_create(&sub, pool);
+
+        keys = apr_palloc(sub, nkeys * sizeof(*keys));
+        for (i = 0; i < nkeys; i++)
+            keys[i] = keysets[s].gen(sub, i);
+
+        for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+            printf("%s / %s\n", keysets[s].name, funcs[f].name);
+            timing(keys, funcs[f].flags, sub);
+            chains(keys, funcs[f].func, sub);
+        }
+#if APR_HAS_THREADS
+        if (nthreads) {
+            printf("%s / concurrent\n", keysets[s].name);
+            concurrent(keys, sub);
+        }
+#endif
+        printf("\n");
+
+        apr_pool_destroy(sub);
+    }
+
+    return 0;
+}
@@ -18,6 +18,7 @@
 #include "testutil.h"
 #include "apr_buckets.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h"
 
 static void test_create(abts_case *tc, void *data)
 {
@@ -511,6 +512,861 @@ static void test_write_putstrs(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+#define SBB_FNAME "data/sendbrigade.txt"
+#define SBB_FILE_SIZE 10000
+#define SBB_HEAP_COUNT 256
+#define SBB_HEAP_SIZE 65536
+
+/* Connect a pair of TCP sockets over the loopback */
+static apr_status_t socket_pair(apr_socket_t **client, apr_socket_t **server,
+                                apr_pool_t *pool)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_create(&listener, sa->family, SOCK_STREAM,
+                               APR_PROTO_TCP, pool);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_bind(listener, sa);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_listen(listener, 1);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_create(client, sa->family, SOCK_STREAM,
+                               APR_PROTO_TCP, pool);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_connect(*client, sa);
+    if (rv == APR_SUCCESS)
+        rv = apr_socket_accept(server, listener, pool);
+    return rv;
+}
+
+/* Receive exactly len bytes */
+static apr_status_t recv_all(apr_socket_t *sock, char *buf, apr_size_t len)
+{
+    apr_size_t n;
+    apr_status_t rv;
+
+    while (len) {
+        n = len;
+        if ((rv = apr_socket_recv(sock, buf, &n)) != APR_SUCCESS)
+            return rv;
+        buf += n;
+        len -= n;
+    }
+    return APR_SUCCESS;
+}
+
+static void test_send_brigade(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_file_t *f;
+    apr_size_t len, total;
+    char *content, *expect, *buf;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "connect sockets", socket_pair(&client, &server, p));
+
+    content = apr_palloc(p, SBB_FILE_SIZE);
+    for (i = 0; i < SBB_FILE_SIZE; i++)
+        content[i] = 'a' + i % 26;
+    len = SBB_FILE_SIZE;
+    APR_ASSERT_SUCCESS(tc, "create test file",
+                       apr_file_open(&f, SBB_FNAME,
+                                     APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                                   | APR_FOPEN_TRUNCATE, APR_FPROT_OS_DEFAULT,
+                                     p));
+    APR_ASSERT_SUCCESS(tc, "write test file", apr_file_write(f, content, &len));
+    apr_file_close(f);
+    APR_ASSERT_SUCCESS(tc, "open test file",
+                       apr_file_open(&f, SBB_FNAME,
+                                     APR_FOPEN_READ
+                                   | APR_FOPEN_SENDFILE_ENABLED,
+                                     APR_FPROT_OS_DEFAULT, p));
+
+    /* header, file (sendfile), small file (read), trailer */
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("HEAD:", 5, ba));
+    apr_brigade_insert_file(bb, f, 100, 5000, p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    apr_brigade_insert_file(bb, f, 0, 10, p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create(":TAIL", 5, NULL, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    expect = apr_pstrcat(p, "HEAD:", apr_pstrndup(p, content + 100, 5000),
+                         apr_pstrndup(p, content, 10), ":TAIL", NULL);
+    total = strlen(expect);
+
+    APR_ASSERT_SUCCESS(tc, "send brigade",
+                       apr_socket_send_brigade(client, bb, &len));
+    ABTS_SIZE_EQUAL(tc, total, len);
+    ABTS_ASSERT(tc, "brigade consumed", APR_BRIGADE_EMPTY(bb));
+
+    buf = apr_pcalloc(p, total + 1);
+    APR_ASSERT_SUCCESS(tc, "receive data", recv_all(server, buf, total));
+    ABTS_STR_EQUAL(tc, expect, buf);
+
+    /* Nonblocking: partial writes leave the rest in the brigade */
+    apr_socket_timeout_set(client, 0);
+    content = apr_palloc(p, SBB_HEAP_SIZE);
+    for (i = 0; i < SBB_HEAP_COUNT; i++) {
+        memset(content, 'A' + i % 26, SBB_HEAP_SIZE);
+        apr_brigade_write(bb, NULL, NULL, content, SBB_HEAP_SIZE);
+    }
+    total = 0;
+    for (;;) {
+        apr_off_t left, before;
+        apr_status_t rv;
+
+        apr_brigade_length(bb, 1, &before);
+        rv = apr_socket_send_brigade(client, bb, &len);
+        apr_brigade_length(bb, 1, &left);
+        ABTS_ASSERT(tc, "sent bytes removed", left + len == before);
+        total += len;
+        if (rv == APR_SUCCESS)
+            break;
+        ABTS_ASSERT(tc, "would block", APR_STATUS_IS_EAGAIN(rv));
+        if (!APR_STATUS_IS_EAGAIN(rv))
+            break;
+
+        buf = apr_palloc(p, total);
+        APR_ASSERT_SUCCESS(tc, "receive data", recv_all(server, buf, total));
+        total = 0;
+    }
+    ABTS_ASSERT(tc, "brigade consumed", APR_BRIGADE_EMPTY(bb));
+    buf = apr_palloc(p, total);
+    APR_ASSERT_SUCCESS(tc, "receive data", recv_all(server, buf, total));
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_file_close(f);
+    apr_file_remove(SBB_FNAME, p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#define SPLICE_SIZE 100000
+
+static void test_splice(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server, *client2, *server2;
+    apr_file_t *in, *out;
+    apr_bucket *e;
+    apr_size_t len, total;
+    apr_status_t rv;
+    char *content, *expect, *buf;
+    char c;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "connect sockets", socket_pair(&client, &server, p));
+    APR_ASSERT_SUCCESS(tc, "connect sockets",
+                       socket_pair(&client2, &server2, p));
+
+    /* pipe -> socket */
+    APR_ASSERT_SUCCESS(tc, "create pipe",
+                       apr_file_pipe_create_ex(&in, &out, APR_FULL_BLOCK, p));
+    len = 11;
+    APR_ASSERT_SUCCESS(tc, "write pipe", apr_file_write(out, "hello pipe!", &len));
+    apr_file_close(out);
+
+    e = apr_bucket_pipe_create(in, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    len = 4;
+    rv = apr_bucket_splice(e, server, &len, APR_BLOCK_READ);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_bucket_splice");
+        apr_brigade_destroy(bb);
+        apr_bucket_alloc_destroy(ba);
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "splice pipe bucket", rv);
+    ABTS_SIZE_EQUAL(tc, 4, len);
+    ABTS_PTR_EQUAL(tc, e, APR_BRIGADE_FIRST(bb));
+    ABTS_ASSERT(tc, "still a pipe bucket", APR_BUCKET_IS_PIPE(e));
+
+    total = len;
+    apr_socket_timeout_set(server, apr_time_from_sec(5));
+    do {
+        len = 1024;
+        APR_ASSERT_SUCCESS(tc, "splice pipe bucket",
+                           apr_bucket_splice(e, server, &len, APR_BLOCK_READ));
+        total += len;
+
+        /* Short because of the pipe, not the socket */
+        APR_ASSERT_SUCCESS(tc, "get incomplete write",
+                           apr_socket_opt_get(server, APR_INCOMPLETE_WRITE,
+                                              &i));
+        ABTS_INT_EQUAL(tc, 0, i);
+    } while (len);
+    ABTS_SIZE_EQUAL(tc, 11, total);
+    ABTS_ASSERT(tc, "empty at EOF", APR_BUCKET_IS_IMMORTAL(e) && !e->length);
+    apr_bucket_delete(e);
+
+    buf = apr_pcalloc(p, 12);
+    APR_ASSERT_SUCCESS(tc, "receive data", recv_all(client, buf, 11));
+    ABTS_STR_EQUAL(tc, "hello pipe!", buf);
+
+    /* socket -> socket, through apr_socket_send_brigade() */
+    content = apr_palloc(p, SPLICE_SIZE);
+    for (i = 0; i < SPLICE_SIZE; i++)
+        content[i] = 'a' + i % 26;
+    len = SPLICE_SIZE;
+    APR_ASSERT_SUCCESS(tc, "send data", apr_socket_send(client, content, &len));
+    apr_socket_shutdown(client, APR_SHUTDOWN_WRITE);
+
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("HEAD:", 5, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create(server, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create(":TAIL", 5, ba));
+    APR_ASSERT_SUCCESS(tc, "send brigade",
+                       apr_socket_send_brigade(client2, bb, &len));
+    ABTS_SIZE_EQUAL(tc, SPLICE_SIZE + 10, len);
+    ABTS_ASSERT(tc, "brigade consumed", APR_BRIGADE_EMPTY(bb));
+
+    expect = apr_pstrcat(p, "HEAD:", apr_pstrndup(p, content, SPLICE_SIZE),
+                         ":TAIL", NULL);
+    buf = apr_pcalloc(p, SPLICE_SIZE + 11);
+    APR_ASSERT_SUCCESS(tc, "receive data",
+                       recv_all(server2, buf, SPLICE_SIZE + 10));
+    ABTS_STR_EQUAL(tc, expect, buf);
+
+    /* Pipes with data read already, buffered or pushed back */
+    APR_ASSERT_SUCCESS(tc, "create pipe",
+                       apr_file_pipe_create_ex(&in, &out, APR_FULL_BLOCK, p));
+    apr_file_puts("buffered pipe, ", out);
+    apr_file_close(out);
+    apr_file_buffer_set(in, apr_palloc(p, 64), 64);
+    apr_file_getc(&c, in);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pipe_create(in, ba));
+    APR_ASSERT_SUCCESS(tc, "create pipe",
+                       apr_file_pipe_create_ex(&in, &out, APR_FULL_BLOCK, p));
+    apr_file_puts("pushed back", out);
+    apr_file_close(out);
+    apr_file_getc(&c, in);
+    apr_file_ungetc(c, in);
+    e = apr_bucket_pipe_create(in, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    len = 4;
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL,
+                   apr_bucket_splice(e, server, &len, APR_BLOCK_READ));
+    APR_ASSERT_SUCCESS(tc, "send brigade",
+                       apr_socket_send_brigade(server, bb, &len));
+    ABTS_SIZE_EQUAL(tc, 25, len);
+    buf = apr_pcalloc(p, 26);
+    apr_socket_timeout_set(client, apr_time_from_sec(5));
+    APR_ASSERT_SUCCESS(tc, "receive data", recv_all(client, buf, 25));
+    ABTS_STR_EQUAL(tc, "uffered pipe, pushed back", buf);
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_socket_close(client2);
+    apr_socket_close(server2);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_alloc_cache(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_alloc_stats_t stats;
+    void *mem, *small;
+
+    small = apr_bucket_alloc(16, ba);
+    mem = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, ba);
+    ABTS_PTR_NOTNULL(tc, mem);
+    apr_bucket_free(small);
+    apr_bucket_free(mem);
+
+    apr_bucket_alloc_stats_get(ba, &stats);
+    ABTS_SIZE_EQUAL(tc, 1, stats.blocks);
+    ABTS_SIZE_EQUAL(tc, 1, stats.small_free);
+    ABTS_SIZE_EQUAL(tc, 1, stats.large_allocs);
+    ABTS_SIZE_EQUAL(tc, 0, stats.large_hits);
+    ABTS_SIZE_EQUAL(tc, 1, stats.large_cached);
+    ABTS_ASSERT(tc, "cached bytes",
+                stats.large_cached_bytes > APR_BUCKET_BUFF_SIZE);
+
+    /* Same size class, from the cache */
+    ABTS_PTR_EQUAL(tc, mem, apr_bucket_alloc(APR_BUCKET_BUFF_SIZE - 100, ba));
+    apr_bucket_alloc_stats_get(ba, &stats);
+    ABTS_SIZE_EQUAL(tc, 2, stats.large_allocs);
+    ABTS_SIZE_EQUAL(tc, 1, stats.large_hits);
+    ABTS_SIZE_EQUAL(tc, 0, stats.large_cached);
+    ABTS_SIZE_EQUAL(tc, 0, stats.large_cached_bytes);
+
+    /* Larger than the cache can hold */
+    apr_bucket_free(mem);
+    mem = apr_bucket_alloc(APR_BUCKET_ALLOC_CACHE_MAX_DEFAULT, ba);
+    apr_bucket_free(mem);
+    apr_bucket_alloc_stats_get(ba, &stats);
+    ABTS_SIZE_EQUAL(tc, 1, stats.large_cached);
+
+    apr_bucket_alloc_cache_max_set(ba, 0);
+    apr_bucket_alloc_stats_get(ba, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, stats.large_cached);
+    mem = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, ba);
+    apr_bucket_free(mem);
+    apr_bucket_alloc_stats_get(ba, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, stats.large_cached);
+    ABTS_SIZE_EQUAL(tc, 1, stats.large_hits);
+
+    apr_bucket_alloc_destroy(ba);
+}
+
+#define ADAPT_SIZE 500000
+
+/* Read n bytes from the socket bucket at the head of the brigade, and
+ * return the size of the largest read.
+ */
+static apr_size_t read_socket_buckets(abts_case *tc, apr_bucket_brigade *bb,
+                                      apr_size_t n)
+{
+    apr_bucket *e;
+    apr_size_t len, largest = 0;
+    const char *str;
+
+    while (n) {
+        e = APR_BRIGADE_FIRST(bb);
+        APR_ASSERT_SUCCESS(tc, "read socket bucket",
+                           apr_bucket_read(e, &str, &len, APR_BLOCK_READ));
+        if (len > largest)
+            largest = len;
+        n -= len;
+        apr_bucket_delete(e);
+    }
+    return largest;
+}
+
+static void test_read_size(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket_brigade *bb2 = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server, *client2, *server2;
+    apr_bucket *e;
+    apr_size_t len, largest, alloc_len;
+    const char *str;
+    char *content;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "connect sockets", socket_pair(&client, &server, p));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create(server, ba));
+    content = apr_pcalloc(p, ADAPT_SIZE);
+
+    /* Bulk data: the reads grow */
+    len = ADAPT_SIZE;
+    APR_ASSERT_SUCCESS(tc, "send data", apr_socket_send(client, content, &len));
+    largest = read_socket_buckets(tc, bb, ADAPT_SIZE);
+    ABTS_ASSERT(tc, "reads grew", largest > 2 * APR_BUCKET_BUFF_SIZE);
+    ABTS_ASSERT(tc, "up to the maximum",
+                largest <= APR_BUCKET_READ_MAX_DEFAULT);
+
+    /* Small messages: the buffers shrink */
+    alloc_len = APR_BUCKET_READ_MAX_DEFAULT + 1;
+    for (i = 0; i < 8; i++) {
+        len = 10;
+        apr_socket_send(client, content, &len);
+        e = APR_BRIGADE_FIRST(bb);
+        APR_ASSERT_SUCCESS(tc, "read socket bucket",
+                           apr_bucket_read(e, &str, &len, APR_BLOCK_READ));
+        ABTS_SIZE_EQUAL(tc, 10, len);
+        ABTS_ASSERT(tc, "buffer shrank or is minimal",
+                    ((apr_bucket_heap *)e->data)->alloc_len < alloc_len
+                    || alloc_len < 2 * APR_BUCKET_BUFF_SIZE);
+        alloc_len = ((apr_bucket_heap *)e->data)->alloc_len;
+        apr_bucket_delete(e);
+    }
+    ABTS_ASSERT(tc, "back to the default", alloc_len < 2 * APR_BUCKET_BUFF_SIZE);
+
+    /* Capped */
+    apr_bucket_socket_read_max_set(server, 4000);
+    len = ADAPT_SIZE;
+    APR_ASSERT_SUCCESS(tc, "send data", apr_socket_send(client, content, &len));
+    largest = read_socket_buckets(tc, bb, ADAPT_SIZE);
+    ABTS_ASSERT(tc, "reads capped", largest <= 4000);
+
+    /* Not the ones of another socket of the same pool */
+    APR_ASSERT_SUCCESS(tc, "connect sockets",
+                       socket_pair(&client2, &server2, p));
+    APR_BRIGADE_INSERT_TAIL(bb2, apr_bucket_socket_create(server2, ba));
+    len = ADAPT_SIZE;
+    APR_ASSERT_SUCCESS(tc, "send data", apr_socket_send(client2, content, &len));
+    largest = read_socket_buckets(tc, bb2, ADAPT_SIZE);
+    ABTS_ASSERT(tc, "reads not capped", largest > 4000);
+
+    apr_socket_close(client2);
+    apr_socket_close(server2);
+    apr_brigade_destroy(bb2);
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_split_delims(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bin, *bout;
+    apr_brigade_delims_t lf = { "\n", 1, 0 };
+    apr_brigade_delims_t crlf = { "\n", 1, 1 };
+    apr_brigade_delims_t multi = { "\n;\0", 3, 0 };
+    apr_brigade_delims_t none = { "", 0, 0 };
+    apr_brigade_line_t line;
+    apr_bucket *e;
+    char buf[64];
+    apr_size_t len;
+    apr_off_t length;
+
+    bin = make_simple_brigade(ba, "the first line is long enough\r",
+                              "\nsecond\nthird");
+    bout = apr_brigade_create(p, ba);
+
+    /* The CR before the LF is in the previous bucket */
+    e = APR_BRIGADE_FIRST(bin);
+    APR_ASSERT_SUCCESS(tc, "find line",
+                       apr_brigade_line_find(bin, &lf, APR_BLOCK_READ,
+                                             8192, &line));
+    ABTS_INT_EQUAL(tc, 31, (int)line.length);
+    ABTS_SIZE_EQUAL(tc, 2, line.delim_len);
+    ABTS_PTR_EQUAL(tc, APR_BUCKET_NEXT(e), line.end);
+    ABTS_SIZE_EQUAL(tc, 1, line.end_offset);
+
+    /* No copy: the same buckets are moved */
+    APR_ASSERT_SUCCESS(tc, "split line",
+                       apr_brigade_split_delims(bout, bin, &lf, APR_BLOCK_READ,
+                                                8192));
+    ABTS_PTR_EQUAL(tc, e, APR_BRIGADE_FIRST(bout));
+    len = sizeof(buf);
+    apr_brigade_flatten(bout, buf, &len);
+    ABTS_STR_NEQUAL(tc, "the first line is long enough\r\n", buf, len);
+    apr_brigade_cleanup(bout);
+
+    APR_ASSERT_SUCCESS(tc, "split line",
+                       apr_brigade_split_delims(bout, bin, &lf, APR_BLOCK_READ,
+                                                8192));
+    len = sizeof(buf);
+    apr_brigade_flatten(bout, buf, &len);
+    ABTS_STR_NEQUAL(tc, "second\n", buf, len);
+    apr_brigade_cleanup(bout);
+
+    /* Incomplete line */
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE,
+                   apr_brigade_line_find(bin, &lf, APR_BLOCK_READ,
+                                         8192, &line));
+    ABTS_INT_EQUAL(tc, 5, (int)line.length);
+    ABTS_SIZE_EQUAL(tc, 0, line.delim_len);
+    apr_brigade_cleanup(bin);
+
+    /* Strict CRLF: bare LFs are part of the line */
+    apr_brigade_puts(bin, NULL, NULL, "a bare\nLF then\r\nCRLF");
+    APR_ASSERT_SUCCESS(tc, "split line",
+                       apr_brigade_split_delims(bout, bin, &crlf,
+                                                APR_BLOCK_READ,
+                                                8192));
+    len = sizeof(buf);
+    apr_brigade_flatten(bout, buf, &len);
+    ABTS_STR_NEQUAL(tc, "a bare\nLF then\r\n", buf, len);
+    apr_brigade_cleanup(bout);
+    apr_brigade_cleanup(bin);
+
+    /* Any of the delimiters, at any offset in the words */
+    apr_brigade_write(bin, NULL, NULL, "key=value;more\0of it\nend", 24);
+    APR_ASSERT_SUCCESS(tc, "find line",
+                       apr_brigade_line_find(bin, &multi, APR_BLOCK_READ,
+                                             8192, &line));
+    ABTS_INT_EQUAL(tc, 10, (int)line.length);
+    apr_brigade_split_delims(bout, bin, &multi, APR_BLOCK_READ,
+                             8192);
+    apr_brigade_split_delims(bout, bin, &multi, APR_BLOCK_READ,
+                             8192);
+    apr_brigade_length(bout, 1, &length);
+    ABTS_INT_EQUAL(tc, 15, (int)length);
+    apr_brigade_cleanup(bout);
+    APR_ASSERT_SUCCESS(tc, "find line",
+                       apr_brigade_line_find(bin, &multi, APR_BLOCK_READ,
+                                             8192, &line));
+    ABTS_INT_EQUAL(tc, 6, (int)line.length);
+    apr_brigade_cleanup(bin);
+
+    /* Maximum line length */
+    apr_brigade_puts(bin, NULL, NULL, "0123456789");
+    apr_brigade_puts(bin, NULL, NULL, "0123456789");
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE,
+                   apr_brigade_line_find(bin, &lf, APR_BLOCK_READ, 5, &line));
+    ABTS_INT_EQUAL(tc, 20, (int)line.length);
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_brigade_line_find(bin, &none, APR_BLOCK_READ,
+                                         8192, &line));
+
+    apr_brigade_destroy(bin);
+    apr_brigade_destroy(bout);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_coalesce(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket *e, *flush, *big;
+    apr_size_t merged;
+    char buf[128], *str;
+    apr_size_t len;
+    int i, count;
+
+    /* 10 x 3 bytes, a flush, 6 x 3 bytes, a large one, 1 x 3 bytes */
+    for (i = 0; i < 10; i++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create("abc", 3, ba));
+    }
+    flush = apr_bucket_flush_create(ba);
+    APR_BRIGADE_INSERT_TAIL(bb, flush);
+    for (i = 0; i < 6; i++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("def", 3, ba));
+    }
+    big = apr_bucket_immortal_create("0123456789012345", 16, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, big);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create("ghi", 3, NULL, ba));
+
+    APR_ASSERT_SUCCESS(tc, "coalesce", apr_brigade_coalesce(bb, 16, &merged));
+    ABTS_SIZE_EQUAL(tc, 15, merged);
+
+    /* 15 + 15 bytes, flush, 15 + 3 bytes, the large one, then the last */
+    count = 0;
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 7, count);
+    e = APR_BRIGADE_FIRST(bb);
+    ABTS_ASSERT(tc, "heap bucket", APR_BUCKET_IS_HEAP(e));
+    ABTS_SIZE_EQUAL(tc, 15, e->length);
+    ABTS_PTR_EQUAL(tc, flush, APR_BUCKET_NEXT(APR_BUCKET_NEXT(e)));
+    ABTS_PTR_EQUAL(tc, big, APR_BUCKET_PREV(APR_BRIGADE_LAST(bb)));
+
+    len = sizeof(buf);
+    apr_brigade_flatten(bb, buf, &len);
+    str = apr_pstrcat(p, "abcabcabcabcabcabcabcabcabcabc",
+                      "defdefdefdefdefdef", "0123456789012345", "ghi", NULL);
+    ABTS_STR_NEQUAL(tc, str, buf, len);
+    ABTS_SIZE_EQUAL(tc, strlen(str), len);
+
+    /* Nothing more to merge */
+    APR_ASSERT_SUCCESS(tc, "coalesce", apr_brigade_coalesce(bb, 16, &merged));
+    ABTS_SIZE_EQUAL(tc, 0, merged);
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#if APR_HAS_THREADS
+
+typedef struct {
+    apr_bucket_brigade *out;
+    char buf[32];
+    apr_size_t len;
+} handoff_t;
+
+static void * APR_THREAD_FUNC consumer_thread(apr_thread_t *thd, void *data)
+{
+    handoff_t *h = data;
+    apr_status_t rv;
+
+    /* Freed from here, the memory is queued for the producer */
+    h->len = sizeof(h->buf);
+    rv = apr_brigade_flatten(h->out, h->buf, &h->len);
+    apr_brigade_cleanup(h->out);
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_transfer(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba, *shared;
+    apr_bucket_alloc_stats_t before, after;
+    apr_bucket_brigade *bb;
+    apr_thread_t *thread;
+    apr_status_t rv, retval;
+    handoff_t h;
+    apr_bucket *e, *kept;
+    apr_bucket_heap *heap;
+    int count = 0;
+
+    /* This thread produces, and owns the shared allocator */
+    shared = apr_bucket_alloc_create(p);
+    rv = apr_bucket_alloc_shared_set(shared);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    bb = apr_brigade_create(p, shared);
+    apr_brigade_write(bb, NULL, NULL, "hello ", 6);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create("world", 5,
+                                                            shared));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pool_create(apr_pstrdup(p, "!"),
+                                                       1, p, shared));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(shared));
+    apr_bucket_copy(APR_BRIGADE_FIRST(bb), &kept);
+
+    ba = apr_bucket_alloc_create(p);
+    h.out = apr_brigade_create(p, ba);
+    APR_ASSERT_SUCCESS(tc, "transfer",
+                       apr_brigade_transfer_to_alloc(h.out, bb));
+    ABTS_ASSERT(tc, "brigade emptied", APR_BRIGADE_EMPTY(bb));
+
+    /* Rehomed, the memory ones being heap buckets */
+    for (e = APR_BRIGADE_FIRST(h.out); e != APR_BRIGADE_SENTINEL(h.out);
+         e = APR_BUCKET_NEXT(e)) {
+        ABTS_PTR_EQUAL(tc, ba, e->list);
+        if (count++ < 3) {
+            ABTS_ASSERT(tc, "heap bucket", APR_BUCKET_IS_HEAP(e));
+        }
+    }
+    ABTS_INT_EQUAL(tc, 4, count);
+    ABTS_ASSERT(tc, "EOS bucket", APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(h.out)));
+
+    /* Shared with the copy kept by the producer, atomically */
+    heap = APR_BRIGADE_FIRST(h.out)->data;
+    ABTS_PTR_EQUAL(tc, heap, kept->data);
+    ABTS_INT_EQUAL(tc, 1, heap->refcount.atomic);
+    ABTS_INT_EQUAL(tc, 2, (int)heap->refcount.refcount);
+
+    /* The consumer thread uses (and frees) the buckets from now on */
+    apr_bucket_alloc_stats_get(shared, &before);
+    rv = apr_thread_create(&thread, NULL, consumer_thread, &h, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_join(&retval, thread);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    ABTS_STR_NEQUAL(tc, "hello world!", h.buf, h.len);
+    ABTS_SIZE_EQUAL(tc, 12, h.len);
+    ABTS_INT_EQUAL(tc, 1, (int)heap->refcount.refcount);
+    apr_bucket_alloc_stats_get(shared, &after);
+    ABTS_SIZE_EQUAL(tc, before.small_free, after.small_free);
+
+    /* Back to the owner to free the rest and destroy the allocator */
+    apr_bucket_destroy(kept);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(shared);
+    apr_brigade_destroy(h.out);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void * APR_THREAD_FUNC file_consumer_thread(apr_thread_t *thd,
+                                                   void *data)
+{
+    handoff_t *h = data;
+    apr_bucket *e;
+    const char *str;
+    apr_size_t len;
+    apr_status_t rv = APR_SUCCESS;
+
+    h->len = 0;
+    for (e = APR_BRIGADE_FIRST(h->out);
+         e != APR_BRIGADE_SENTINEL(h->out) && rv == APR_SUCCESS;
+         e = APR_BUCKET_NEXT(e)) {
+        rv = apr_bucket_read(e, &str, &len, APR_BLOCK_READ);
+        /* Mapped in the producer's pool */
+        if (APR_BUCKET_IS_MMAP(e)) {
+            rv = APR_EGENERAL;
+        }
+        h->len += len;
+    }
+    apr_brigade_cleanup(h->out);
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_transfer_file(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba, *shared;
+    apr_bucket_brigade *bb;
+    apr_thread_t *thread;
+    apr_status_t rv, retval;
+    handoff_t h;
+    apr_bucket *e;
+    apr_bucket_file *a;
+    apr_file_t *f;
+    apr_size_t size = 3 * APR_BUCKET_BUFF_SIZE, total = size;
+    char *str;
+
+    str = apr_palloc(p, size + 1);
+    memset(str, 'x', size);
+    str[size] = '\0';
+    f = make_test_file(tc, "transfer.bin", str);
+
+    shared = apr_bucket_alloc_create(p);
+    rv = apr_bucket_alloc_shared_set(shared);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    bb = apr_brigade_create(p, shared);
+    apr_brigade_insert_file(bb, f, 0, size, p);
+#if APR_HAS_MMAP
+    {
+        apr_mmap_t *mm;
+
+        APR_ASSERT_SUCCESS(tc, "mmap file",
+                           apr_mmap_create(&mm, f, 0, size, APR_MMAP_READ, p));
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_mmap_create(mm, 0, size,
+                                                           shared));
+        total += size;
+    }
+#endif
+
+    ba = apr_bucket_alloc_create(p);
+    h.out = apr_brigade_create(p, ba);
+    APR_ASSERT_SUCCESS(tc, "transfer",
+                       apr_brigade_transfer_to_alloc(h.out, bb));
+
+    /* Read with positional reads only, the mmap being copied */
+    e = APR_BRIGADE_FIRST(h.out);
+    ABTS_ASSERT(tc, "file bucket", APR_BUCKET_IS_FILE(e));
+    a = e->data;
+    ABTS_INT_EQUAL(tc, 0, (int)a->readahead);
+#if APR_HAS_MMAP
+    ABTS_INT_EQUAL(tc, 0, a->can_mmap);
+    ABTS_ASSERT(tc, "heap bucket", APR_BUCKET_IS_HEAP(APR_BRIGADE_LAST(h.out)));
+#endif
+
+    rv = apr_thread_create(&thread, NULL, file_consumer_thread, &h, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_join(&retval, thread);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    ABTS_SIZE_EQUAL(tc, total, h.len);
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(shared);
+    apr_brigade_destroy(h.out);
+    apr_bucket_alloc_destroy(ba);
+    apr_file_close(f);
+    apr_file_remove("transfer.bin", p);
+}
+
+#endif /* APR_HAS_THREADS */
+
+static void test_shm(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_size_t size = APR_ALIGN_DEFAULT(8192);
+    apr_rmm_off_t region, again;
+    apr_rmm_t *rmm;
+    apr_bucket *e, *c;
+    const char *str;
+    char *addr;
+    char buf[32];
+    apr_size_t len;
+
+    APR_ASSERT_SUCCESS(tc, "create rmm",
+                       apr_rmm_init(&rmm, NULL, apr_palloc(p, size), size, p));
+    APR_ASSERT_SUCCESS(tc, "allocate region",
+                       apr_bucket_shm_region_alloc(&region, rmm, 32));
+    addr = apr_bucket_shm_region_addr(rmm, region);
+    memcpy(addr, "shared response", 15);
+
+    e = apr_bucket_shm_create(rmm, region, 7, 8, ba);
+    ABTS_ASSERT(tc, "SHM bucket", APR_BUCKET_IS_SHM(e));
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    apr_bucket_copy(e, &c);
+    APR_BRIGADE_INSERT_HEAD(bb, c);
+    apr_bucket_split(c, 6);
+
+    /* Read in place */
+    APR_ASSERT_SUCCESS(tc, "read", apr_bucket_read(e, &str, &len,
+                                                   APR_BLOCK_READ));
+    ABTS_PTR_EQUAL(tc, addr + 7, str);
+    ABTS_SIZE_EQUAL(tc, 8, len);
+    len = sizeof(buf);
+    apr_brigade_flatten(bb, buf, &len);
+    ABTS_STR_NEQUAL(tc, "responseresponse", buf, len);
+
+    /* The buckets keep the region once the creator released it */
+    apr_bucket_shm_region_release(rmm, region);
+    apr_bucket_delete(c);
+    APR_ASSERT_SUCCESS(tc, "read", apr_bucket_read(e, &str, &len,
+                                                   APR_BLOCK_READ));
+    ABTS_STR_NEQUAL(tc, "response", str, len);
+
+    /* Freed with the last bucket, so it can be allocated again */
+    apr_brigade_cleanup(bb);
+    APR_ASSERT_SUCCESS(tc, "allocate region",
+                       apr_bucket_shm_region_alloc(&again, rmm, 32));
+    ABTS_INT_EQUAL(tc, (int)region, (int)again);
+    apr_bucket_shm_region_release(rmm, again);
+
+    apr_rmm_destroy(rmm);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#define RA_FNAME "readahead.bin"
+#define RA_SIZE  (100 * 1000)
+
+static void test_readahead(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket_file *a;
+    apr_bucket *e;
+    apr_file_t *f;
+    apr_off_t offset = 0;
+    const char *str;
+    char *contents;
+    apr_size_t len;
+    int i, mismatch = 0, behind = 0;
+
+    contents = apr_palloc(p, RA_SIZE + 1);
+    for (i = 0; i < RA_SIZE; i++) {
+        contents[i] = 'a' + i % 26;
+    }
+    contents[RA_SIZE] = '\0';
+    f = make_test_file(tc, RA_FNAME, contents);
+
+    /* Read by blocks, advised ahead of the reads */
+    e = apr_bucket_file_create(f, 0, RA_SIZE, p, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    apr_bucket_file_enable_mmap(e, 0);
+    apr_bucket_file_readahead_set(e, 32 * 1024);
+    a = e->data;
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        APR_ASSERT_SUCCESS(tc, "read file bucket",
+                           apr_bucket_read(e, &str, &len, APR_BLOCK_READ));
+        if (memcmp(str, contents + offset, len))
+            mismatch = 1;
+        offset += len;
+        if (a->readahead && offset < RA_SIZE && a->advised < offset)
+            behind = 1;
+        apr_bucket_delete(e);
+    }
+    ABTS_INT_EQUAL(tc, RA_SIZE, (int)offset);
+    ABTS_INT_EQUAL(tc, 0, mismatch);
+    ABTS_INT_EQUAL(tc, 0, behind);
+
+#if APR_HAS_MMAP
+    /* Prefaulted mmap */
+    e = apr_bucket_file_create(f, 0, RA_SIZE, p, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    APR_ASSERT_SUCCESS(tc, "populate",
+                       apr_bucket_file_populate_set(e, RA_SIZE));
+    APR_ASSERT_SUCCESS(tc, "read file bucket",
+                       apr_bucket_read(e, &str, &len, APR_BLOCK_READ));
+    ABTS_ASSERT(tc, "MMAP bucket", APR_BUCKET_IS_MMAP(e));
+    ABTS_SIZE_EQUAL(tc, RA_SIZE, len);
+    ABTS_ASSERT(tc, "mmap contents", memcmp(str, contents, len) == 0);
+#endif
+
+    apr_brigade_destroy(bb);
+    apr_file_close(f);
+    apr_bucket_alloc_destroy(ba);
+    apr_file_remove(RA_FNAME, p);
+}
+
 abts_suite *testbuckets(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -528,6 +1384,18 @@ abts_suite *testbuckets(abts_suite *suite)
     abts_run_test(suite, test_partition, NULL);
     abts_run_test(suite, test_write_split, NULL);
     abts_run_test(suite, test_write_putstrs, NULL);
+    abts_run_test(suite, test_send_brigade, NULL);
+    abts_run_test(suite, test_splice, NULL);
+    abts_run_test(suite, test_alloc_cache, NULL);
+    abts_run_test(suite, test_read_size, NULL);
+    abts_run_test(suite, test_split_delims, NULL);
+    abts_run_test(suite, test_coalesce, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_transfer, NULL);
+    abts_run_test(suite, test_transfer_file, NULL);
+#endif
+    abts_run_test(suite, test_shm, NULL);
+    abts_run_test(suite, test_readahead, NULL);
 
     return suite;
 }
@@ -0,0 +1,214 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_chash.h"
+#include "apr_thread_proc.h"
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define NUM_KEYS 1000
+
+static const char *keys[NUM_KEYS];
+
+static void make_keys(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (!keys[i])
+            keys[i] = apr_psprintf(p, "key%d", i);
+    }
+}
+
+static int count_cb(void *rec, const void *key, apr_ssize_t klen,
+                    const void *val)
+{
+    (*(int *)rec)++;
+    return 1;
+}
+
+static int stop_cb(void *rec, const void *key, apr_ssize_t klen,
+                   const void *val)
+{
+    return --(*(int *)rec) > 0;
+}
+
+/* Only hashes the first 4 characters */
+static unsigned int hash_custom(const char *key, apr_ssize_t *klen)
+{
+    unsigned int hash = 0;
+    apr_ssize_t i;
+
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(key);
+    for (i = 0; i < *klen && i < 4; i++)
+        hash = hash * 33 + key[i];
+    return hash;
+}
+
+static void chash_basic(abts_case *tc, void *data)
+{
+    apr_uint32_t flags[] = { 0, APR_HASH_FLAT, APR_HASH_INCREMENTAL };
+    apr_chash_t *ht;
+    apr_status_t rv;
+    int n, i, missing, count;
+
+    make_keys();
+
+    for (n = 0; n < sizeof(flags) / sizeof(flags[0]); n++) {
+        rv = apr_chash_create(&ht, 0, NULL, flags[n], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 0, apr_chash_count(ht));
+        ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key0",
+                                               APR_HASH_KEY_STRING));
+
+        for (i = 0; i < NUM_KEYS; i++)
+            apr_chash_set(ht, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        ABTS_INT_EQUAL(tc, NUM_KEYS, apr_chash_count(ht));
+
+        missing = 0;
+        for (i = 0; i < NUM_KEYS; i++) {
+            if (apr_chash_get(ht, keys[i], strlen(keys[i])) != keys[i])
+                missing++;
+        }
+        ABTS_INT_EQUAL(tc, 0, missing);
+
+        ABTS_PTR_EQUAL(tc, keys[1],
+                       apr_chash_get_or_set(ht, "key1", APR_HASH_KEY_STRING,
+                                            "other"));
+        ABTS_STR_EQUAL(tc, "new",
+                       apr_chash_get_or_set(ht, "new", APR_HASH_KEY_STRING,
+                                            "new"));
+        ABTS_PTR_EQUAL(tc, NULL,
+                       apr_chash_get_or_set(ht, "none", APR_HASH_KEY_STRING,
+                                            NULL));
+        apr_chash_set(ht, "new", APR_HASH_KEY_STRING, NULL);
+        apr_chash_set(ht, keys[0], APR_HASH_KEY_STRING, NULL);
+        ABTS_INT_EQUAL(tc, NUM_KEYS - 1, apr_chash_count(ht));
+
+        count = 0;
+        ABTS_INT_EQUAL(tc, 1, apr_chash_do(count_cb, &count, ht));
+        ABTS_INT_EQUAL(tc, NUM_KEYS - 1, count);
+        count = 10;
+        ABTS_INT_EQUAL(tc, 0, apr_chash_do(stop_cb, &count, ht));
+        ABTS_INT_EQUAL(tc, 0, count);
+
+        apr_chash_clear(ht);
+        ABTS_INT_EQUAL(tc, 0, apr_chash_count(ht));
+        ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, keys[1],
+                                               APR_HASH_KEY_STRING));
+    }
+}
+
+static void chash_custom(abts_case *tc, void *data)
+{
+    apr_chash_t *ht;
+    apr_status_t rv;
+
+    /* A single shard */
+    rv = apr_chash_create(&ht, 1, hash_custom, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_chash_set(ht, "same1", 5, "same");
+    apr_chash_set(ht, "same2", 5, "same");
+    apr_chash_set(ht, "same1 with more", 5, "again");
+    ABTS_INT_EQUAL(tc, 2, apr_chash_count(ht));
+    ABTS_STR_EQUAL(tc, "again", apr_chash_get(ht, "same1", 5));
+    ABTS_STR_EQUAL(tc, "same", apr_chash_get(ht, "same2",
+                                             APR_HASH_KEY_STRING));
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+#define NUM_ROUNDS  20
+
+static apr_chash_t *shared;
+
+static void * APR_THREAD_FUNC chash_thread(apr_thread_t *thd, void *data)
+{
+    int id = *(int *)data, round, i, failed = 0;
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        /* Each thread owns the keys i % NUM_THREADS == id, and reads all */
+        for (i = id; i < NUM_KEYS; i += NUM_THREADS)
+            apr_chash_set(shared, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        for (i = 0; i < NUM_KEYS; i++) {
+            const char *val = apr_chash_get(shared, keys[i],
+                                            APR_HASH_KEY_STRING);
+            if (i % NUM_THREADS == id ? val != keys[i]
+                                      : val && val != keys[i])
+                failed = 1;
+        }
+        if (round < NUM_ROUNDS - 1) {
+            for (i = id; i < NUM_KEYS; i += NUM_THREADS)
+                apr_chash_set(shared, keys[i], APR_HASH_KEY_STRING, NULL);
+        }
+    }
+
+    apr_thread_exit(thd, failed ? APR_EGENERAL : APR_SUCCESS);
+    return NULL;
+}
+
+static void chash_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *threads[NUM_THREADS];
+    int ids[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    make_keys();
+
+    rv = apr_chash_create(&shared, 8, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        rv = apr_thread_create(&threads[i], NULL, chash_thread, &ids[i], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    ABTS_INT_EQUAL(tc, NUM_KEYS, apr_chash_count(shared));
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testchash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, chash_basic, NULL);
+    abts_run_test(suite, chash_custom, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, chash_threads, NULL);
+#endif
+
+    return suite;
+}
@@ -288,6 +288,73 @@ static void test_seek(abts_case *tc, void *data)
     apr_file_close(filetest);
 }                
 
+static void test_read_at(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_off_t offset = 0;
+    apr_size_t nbytes = 256;
+    char *str = apr_pcalloc(p, nbytes + 1);
+    apr_file_t *filetest = NULL;
+
+    rv = apr_file_open(&filetest, FILENAME,
+                       APR_FOPEN_READ | APR_FOPEN_BUFFERED,
+                       APR_FPROT_UREAD | APR_FPROT_UWRITE | APR_FPROT_GREAD, p);
+    APR_ASSERT_SUCCESS(tc, "Open test file " FILENAME, rv);
+
+    rv = apr_file_read_at(filetest, str, &nbytes, 5);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_file_read_at");
+        apr_file_close(filetest);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, strlen(TESTSTR) - 5, nbytes);
+    ABTS_STR_EQUAL(tc, TESTSTR + 5, str);
+
+    /* The file position did not move */
+    rv = apr_file_seek(filetest, APR_CUR, &offset);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, (int)offset);
+
+    memset(str, 0, nbytes + 1);
+    nbytes = 4;
+    rv = apr_file_read(filetest, str, &nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 4, nbytes);
+    ABTS_STR_EQUAL(tc, "This", str);
+
+    nbytes = 256;
+    rv = apr_file_read_at(filetest, str, &nbytes, strlen(TESTSTR));
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    ABTS_SIZE_EQUAL(tc, 0, nbytes);
+
+    apr_file_close(filetest);
+}
+
+static void test_advise(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_file_t *filetest = NULL;
+
+    rv = apr_file_open(&filetest, FILENAME, APR_FOPEN_READ,
+                       APR_FPROT_UREAD | APR_FPROT_UWRITE | APR_FPROT_GREAD, p);
+    APR_ASSERT_SUCCESS(tc, "Open test file " FILENAME, rv);
+
+    rv = apr_file_advise(filetest, 0, 0, APR_FADVISE_SEQUENTIAL);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_file_advise");
+        apr_file_close(filetest);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_file_advise(filetest, 5, 10, APR_FADVISE_WILLNEED);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_file_advise(filetest, 0, 0, 42);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    apr_file_close(filetest);
+}
+
 static void test_userdata_set(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -2214,6 +2281,8 @@ abts_suite *testfile(abts_suite *suite)
     abts_run_test(suite, test_read, NULL); 
     abts_run_test(suite, test_readzero, NULL); 
     abts_run_test(suite, test_seek, NULL);
+    abts_run_test(suite, test_read_at, NULL);
+    abts_run_test(suite, test_advise, NULL);
     abts_run_test(suite, test_filename, NULL);
     abts_run_test(suite, test_fileclose, NULL);
     abts_run_test(suite, test_file_remove, NULL);
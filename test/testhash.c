@@ -186,6 +186,196 @@ static void same_value_custom(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, "same", result);
 }
 
+static void hashfunc_fast(abts_case *tc, void *data)
+{
+    const char *longkey = "/usr/local/apache2/htdocs/index.html.en";
+    apr_ssize_t klen = APR_HASH_KEY_STRING;
+    unsigned int hash;
+
+    /* The same with or without the length */
+    hash = apr_hashfunc_fast(longkey, &klen);
+    ABTS_INT_EQUAL(tc, (int)strlen(longkey), (int)klen);
+    ABTS_INT_EQUAL(tc, hash, apr_hashfunc_fast(longkey, &klen));
+
+#if !APR_IS_BIGENDIAN
+    /* The low 32 bits of XXH64 (seed 0) */
+    klen = 0;
+    ABTS_INT_EQUAL(tc, 0x51D8E999, apr_hashfunc_fast("", &klen));
+    klen = APR_HASH_KEY_STRING;
+    ABTS_INT_EQUAL(tc, 0xAD770999, apr_hashfunc_fast("abc", &klen));
+#endif
+}
+
+static void hash_make_ex(abts_case *tc, void *data)
+{
+    apr_uint32_t flags[] = { 0, APR_HASH_TIMES33, APR_HASH_FLAT,
+                             APR_HASH_FLAT | APR_HASH_TIMES33,
+                             APR_HASH_INCREMENTAL };
+    char key[128];
+    apr_hash_t *h;
+    int i, n, missing;
+
+    for (n = 0; n < sizeof(flags) / sizeof(flags[0]); n++) {
+        h = apr_hash_make_ex(p, flags[n]);
+        ABTS_PTR_NOTNULL(tc, h);
+
+        /* Keys of all the lengths the hash reads differently */
+        for (i = 0; i < 1000; i++) {
+            apr_snprintf(key, sizeof(key), "%.*s/%d", i % 100,
+                         "/some/long/path/used/as/a/prefix/of/the/keys"
+                         "/some/long/path/used/as/a/prefix/of/the/keys"
+                         "/some/long/path", i);
+            apr_hash_set(h, apr_pstrdup(p, key), APR_HASH_KEY_STRING,
+                         apr_itoa(p, i));
+        }
+        ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+
+        missing = 0;
+        for (i = 0; i < 1000; i++) {
+            const char *val;
+
+            apr_snprintf(key, sizeof(key), "%.*s/%d", i % 100,
+                         "/some/long/path/used/as/a/prefix/of/the/keys"
+                         "/some/long/path/used/as/a/prefix/of/the/keys"
+                         "/some/long/path", i);
+            val = apr_hash_get(h, key, APR_HASH_KEY_STRING);
+            if (!val || atoi(val) != i)
+                missing++;
+        }
+        ABTS_INT_EQUAL(tc, 0, missing);
+    }
+}
+
+static void hash_flat(abts_case *tc, void *data)
+{
+    apr_hash_t *h, *h2, *h3;
+    apr_hash_index_t *hi;
+    int i, round, count, missing;
+
+    h = apr_hash_make_ex(p, APR_HASH_FLAT);
+
+    /* Insert and remove enough to go through deleted slots and rehashes */
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < 500; i++) {
+            apr_hash_set(h, apr_itoa(p, round * 500 + i), APR_HASH_KEY_STRING,
+                         apr_itoa(p, round * 500 + i));
+        }
+        for (i = 0; i < 500; i += 2) {
+            apr_hash_set(h, apr_itoa(p, round * 500 + i), APR_HASH_KEY_STRING,
+                         NULL);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+
+    missing = 0;
+    for (i = 0; i < 2000; i++) {
+        const char *val = apr_hash_get(h, apr_itoa(p, i), APR_HASH_KEY_STRING);
+        if ((i % 2) ? !val || atoi(val) != i : val != NULL)
+            missing++;
+    }
+    ABTS_INT_EQUAL(tc, 0, missing);
+
+    /* Replacing keeps the count */
+    apr_hash_set(h, "1", APR_HASH_KEY_STRING, "one");
+    ABTS_STR_EQUAL(tc, "one", apr_hash_get(h, "1", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "one", apr_hash_get_or_set(h, "1", APR_HASH_KEY_STRING,
+                                                  "uno"));
+    ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+
+    /* Copies and merges, with a chained table too */
+    h2 = apr_hash_copy(p, h);
+    apr_hash_set(h2, "1", APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 999, apr_hash_count(h2));
+    ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+
+    h3 = apr_hash_make(p);
+    apr_hash_set(h3, "1", APR_HASH_KEY_STRING, "eins");
+    apr_hash_set(h3, "new", APR_HASH_KEY_STRING, "neu");
+    h2 = apr_hash_overlay(p, h3, h);
+    ABTS_INT_EQUAL(tc, 1001, apr_hash_count(h2));
+    ABTS_STR_EQUAL(tc, "eins", apr_hash_get(h2, "1", APR_HASH_KEY_STRING));
+    h2 = apr_hash_overlay(p, h, h3);
+    ABTS_INT_EQUAL(tc, 1001, apr_hash_count(h2));
+    ABTS_STR_EQUAL(tc, "one", apr_hash_get(h2, "1", APR_HASH_KEY_STRING));
+
+    /* Removing the current entry while iterating */
+    count = 0;
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        apr_hash_set(h, apr_hash_this_key(hi), apr_hash_this_key_len(hi),
+                     NULL);
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 1000, count);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(p, h));
+
+    apr_hash_set(h2, "new", APR_HASH_KEY_STRING, NULL);
+    apr_hash_clear(h2);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h2));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h2, "3", APR_HASH_KEY_STRING));
+}
+
+static void hash_incremental(abts_case *tc, void *data)
+{
+    apr_hash_t *h, *h2;
+    apr_hash_index_t *hi;
+    int i, j, count, missing = 0, bad_count = 0;
+
+    h = apr_hash_make_ex(p, APR_HASH_INCREMENTAL);
+
+    /* Check everything at each step, during and between expansions */
+    for (i = 0; i < 300; i++) {
+        apr_hash_set(h, apr_itoa(p, i), APR_HASH_KEY_STRING, apr_itoa(p, i));
+
+        for (j = 0; j <= i; j++) {
+            const char *val = apr_hash_get(h, apr_itoa(p, j),
+                                           APR_HASH_KEY_STRING);
+            if (!val || atoi(val) != j)
+                missing++;
+        }
+        count = 0;
+        for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi))
+            count++;
+        if (count != i + 1 || apr_hash_count(h) != i + 1)
+            bad_count++;
+
+        h2 = apr_hash_copy(p, h);
+        if (apr_hash_count(h2) != i + 1
+            || !apr_hash_get(h2, "0", APR_HASH_KEY_STRING))
+            bad_count++;
+    }
+    ABTS_INT_EQUAL(tc, 0, missing);
+    ABTS_INT_EQUAL(tc, 0, bad_count);
+
+    /* Stop while expanding from 511 to 1023 buckets */
+    for (i = 300; i < 520; i++)
+        apr_hash_set(h, apr_itoa(p, i), APR_HASH_KEY_STRING, apr_itoa(p, i));
+
+    /* Removals while expanding */
+    for (i = 0; i < 520; i += 2)
+        apr_hash_set(h, apr_itoa(p, i), APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 260, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "2", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "3", apr_hash_get(h, "3", APR_HASH_KEY_STRING));
+
+    h2 = apr_hash_make(p);
+    apr_hash_set(h2, "3", APR_HASH_KEY_STRING, "three");
+    h2 = apr_hash_overlay(p, h2, h);
+    ABTS_INT_EQUAL(tc, 260, apr_hash_count(h2));
+    ABTS_STR_EQUAL(tc, "three", apr_hash_get(h2, "3", APR_HASH_KEY_STRING));
+
+    /* Replacing and removing while iterating */
+    count = 0;
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        apr_hash_set(h, apr_hash_this_key(hi), APR_HASH_KEY_STRING, "x");
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 260, count);
+    apr_hash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(p, h));
+}
+
 static void key_space(abts_case *tc, void *data)
 {
     apr_hash_t *h = NULL;
@@ -549,6 +739,10 @@ abts_suite *testhash(abts_suite *suite)
     abts_run_test(suite, hash_reset, NULL);
     abts_run_test(suite, same_value, NULL);
     abts_run_test(suite, same_value_custom, NULL);
+    abts_run_test(suite, hashfunc_fast, NULL);
+    abts_run_test(suite, hash_make_ex, NULL);
+    abts_run_test(suite, hash_flat, NULL);
+    abts_run_test(suite, hash_incremental, NULL);
     abts_run_test(suite, key_space, NULL);
     abts_run_test(suite, delete_key, NULL);
 
@@ -141,6 +141,36 @@ static void test_mmap_offset(abts_case *tc, void *data)
     /* Must use nEquals since the string is not guaranteed to be NULL terminated */
     ABTS_STR_NEQUAL(tc, addr, test_string + 5, thisfsize-5);
 }
+
+static void test_mmap_advise(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+
+    ABTS_PTR_NOTNULL(tc, themmap);
+    rv = apr_mmap_advise(themmap, 0, themmap->size, APR_FADVISE_SEQUENTIAL);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_mmap_advise");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_mmap_advise(themmap, 5, thisfsize - 5, APR_FADVISE_WILLNEED);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_mmap_advise(themmap, 5, thisfsize, APR_FADVISE_WILLNEED);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+static void test_mmap_populate(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_mmap_t *mm;
+
+    rv = apr_mmap_create(&mm, thefile, 0, (apr_size_t) thisfinfo.size,
+                         APR_MMAP_READ | APR_MMAP_POPULATE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_NEQUAL(tc, mm->mm, test_string, thisfsize);
+    rv = apr_mmap_delete(mm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
 #endif
 
 abts_suite *testmmap(abts_suite *suite)
@@ -155,6 +185,8 @@ abts_suite *testmmap(abts_suite *suite)
     abts_run_test(suite, test_mmap_create, NULL);
     abts_run_test(suite, test_mmap_contents, NULL);
     abts_run_test(suite, test_mmap_offset, NULL);
+    abts_run_test(suite, test_mmap_advise, NULL);
+    abts_run_test(suite, test_mmap_populate, NULL);
     abts_run_test(suite, test_mmap_delete, NULL);
     abts_run_test(suite, test_file_close, NULL);
 #else
@@ -17,8 +17,15 @@
 
 #include "apr_general.h"
 #include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_atomic.h"
+#include "apr_portable.h"
+#include "apr_time.h"
+#include "apr_strings.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -164,6 +171,269 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+#define NUM_HANDLES 1000
+
+static apr_status_t counting_cleanup(void *data)
+{
+    int *count = data;
+
+    (*count)++;
+    return APR_SUCCESS;
+}
+
+static void test_cleanup_handles(abts_case *tc, void *data)
+{
+    apr_pool_cleanup_t *handles[NUM_HANDLES];
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int count = 0, n;
+
+    apr_pool_create(&pool, p);
+
+    for (n = 0; n < NUM_HANDLES; n++) {
+        handles[n] = apr_pool_cleanup_register_handle(pool, &count,
+                                                      counting_cleanup,
+                                                      apr_pool_cleanup_null);
+        ABTS_PTR_NOTNULL(tc, handles[n]);
+    }
+
+    /* Kill every other cleanup, in no particular order */
+    for (n = 1; n < NUM_HANDLES; n += 4)
+        apr_pool_cleanup_kill_handle(pool, handles[n]);
+    for (n = NUM_HANDLES - 1; n > 0; n -= 4)
+        apr_pool_cleanup_kill_handle(pool, handles[n]);
+    ABTS_INT_EQUAL(tc, 0, count);
+
+    rv = apr_pool_cleanup_run_handle(pool, handles[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, count);
+
+    /* Killed cleanups are recycled */
+    ABTS_PTR_EQUAL(tc, handles[0],
+                   apr_pool_cleanup_register_handle(pool, &count,
+                                                    counting_cleanup,
+                                                    apr_pool_cleanup_null));
+
+    /* Mixes with the usual kill */
+    apr_pool_cleanup_kill(pool, &count, counting_cleanup);
+
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, NUM_HANDLES / 2, count);
+
+    apr_pool_destroy(pool);
+}
+
+static void test_palloc_aligned(abts_case *tc, void *data)
+{
+    static const apr_size_t alignments[] = { 1, 8, 16, 32, 64, 4096 };
+    apr_allocator_t *allocator;
+    apr_memnode_t *node;
+    apr_pool_t *pool;
+    apr_size_t alignment, i;
+    char *mem;
+    int n;
+
+    apr_pool_create(&pool, p);
+
+    for (i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++) {
+        alignment = alignments[i];
+        for (n = 0; n < 64; n++) {
+            mem = apr_palloc_aligned(pool, n * 13 + 1, alignment);
+            ABTS_PTR_NOTNULL(tc, mem);
+            ABTS_SIZE_EQUAL(tc, 0, (apr_uintptr_t)mem & (alignment - 1));
+            memset(mem, 'x', n * 13 + 1);
+        }
+        mem = apr_palloc_aligned(pool, ALLOC_BYTES * 64, alignment);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_SIZE_EQUAL(tc, 0, (apr_uintptr_t)mem & (alignment - 1));
+        memset(mem, 'x', ALLOC_BYTES * 64);
+    }
+
+#if !APR_POOL_DEBUG
+    /* Taken from the active node, with no more padding than needed */
+    mem = apr_palloc_aligned(pool, 64, 64);
+    ABTS_PTR_EQUAL(tc, mem + 64, apr_palloc_aligned(pool, 64, 64));
+#endif
+
+    mem = apr_pcalloc_aligned(pool, 100, 32);
+    ABTS_PTR_NOTNULL(tc, mem);
+    ABTS_SIZE_EQUAL(tc, 0, (apr_uintptr_t)mem & 31);
+    for (n = 0; n < 100 && mem[n] == 0; n++)
+        ;
+    ABTS_INT_EQUAL(tc, 100, n);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 10, 24));
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 10, 0));
+
+    apr_pool_destroy(pool);
+
+    allocator = apr_pool_allocator_get(p);
+    node = apr_allocator_alloc_aligned(allocator, ALLOC_BYTES, 4096);
+    ABTS_PTR_NOTNULL(tc, node);
+    ABTS_SIZE_EQUAL(tc, 0, (apr_uintptr_t)node->first_avail & 4095);
+    ABTS_TRUE(tc, node->endp - node->first_avail >= ALLOC_BYTES);
+    apr_allocator_free(allocator, node);
+}
+
+static void test_mark(abts_case *tc, void *data)
+{
+    apr_pool_mark_t outer, inner;
+    apr_pool_stats_t before, after;
+    apr_pool_t *pool;
+    char *keep, *mem;
+    int count = 0, n;
+
+    apr_pool_create(&pool, p);
+    keep = apr_palloc(pool, sizeof("kept"));
+    strcpy(keep, "kept");
+
+    /* Warm up, so that the sentinel cleanup is recycled from now on */
+    apr_pool_mark(pool, &outer);
+    apr_pool_release_to_mark(pool, &outer);
+    apr_pool_stats_get(pool, &before);
+
+    apr_pool_mark(pool, &outer);
+    mem = apr_palloc(pool, 100);
+    for (n = 0; n < 64; n++) {
+        apr_palloc(pool, ALLOC_BYTES);
+        apr_pool_cleanup_register(pool, &count, counting_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+
+    apr_pool_mark(pool, &inner);
+    for (n = 0; n < 16; n++) {
+        apr_palloc(pool, ALLOC_BYTES * 4);
+        apr_pool_cleanup_register(pool, &count, counting_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    apr_pool_release_to_mark(pool, &inner);
+    ABTS_INT_EQUAL(tc, 16, count);
+
+    /* Outer mark released along with an inner one left as is */
+    apr_pool_mark(pool, &inner);
+    apr_palloc(pool, ALLOC_BYTES * 4);
+    apr_pool_release_to_mark(pool, &outer);
+    ABTS_INT_EQUAL(tc, 16 + 64, count);
+    ABTS_STR_EQUAL(tc, "kept", keep);
+
+    apr_pool_stats_get(pool, &after);
+    ABTS_SIZE_EQUAL(tc, before.nodes, after.nodes);
+    ABTS_SIZE_EQUAL(tc, before.bytes_alloc, after.bytes_alloc);
+#if !APR_POOL_DEBUG
+    /* The memory is reused */
+    ABTS_PTR_EQUAL(tc, mem, apr_palloc(pool, 100));
+#endif
+
+    /* The cleanups run are gone */
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, 16 + 64, count);
+
+    apr_pool_destroy(pool);
+}
+
+static void test_mark_pre_cleanups(abts_case *tc, void *data)
+{
+    apr_pool_mark_t mark;
+    apr_pool_t *pool;
+    int count = 0, n;
+
+    apr_pool_create(&pool, p);
+    apr_pool_pre_cleanup_register(pool, &count, counting_cleanup);
+
+    apr_pool_mark(pool, &mark);
+    for (n = 0; n < 8; n++) {
+        apr_palloc(pool, ALLOC_BYTES);
+        apr_pool_pre_cleanup_register(pool, &count, counting_cleanup);
+    }
+    /* One registered since the mark is killed meanwhile */
+    apr_pool_cleanup_kill(pool, &count, counting_cleanup);
+    apr_pool_release_to_mark(pool, &mark);
+    ABTS_INT_EQUAL(tc, 7, count);
+
+    apr_pool_mark(pool, &mark);
+    apr_pool_pre_cleanup_register(pool, &count, counting_cleanup);
+    apr_pool_release_to_mark(pool, &mark);
+    ABTS_INT_EQUAL(tc, 8, count);
+
+    apr_pool_destroy(pool);
+    ABTS_INT_EQUAL(tc, 9, count);
+}
+
+static void test_mark_userdata(abts_case *tc, void *data)
+{
+    apr_pool_mark_t outer, inner;
+    apr_pool_t *pool;
+    void *val;
+    int n;
+
+    /* Created after the mark */
+    apr_pool_create(&pool, p);
+    apr_pool_mark(pool, &outer);
+    apr_pool_userdata_set("new", "key", NULL, pool);
+    apr_pool_release_to_mark(pool, &outer);
+    apr_pool_userdata_get(&val, "key", pool);
+    ABTS_PTR_EQUAL(tc, NULL, val);
+
+    /* Set before and changed after the marks */
+    apr_pool_userdata_setn("old", "key", NULL, pool);
+    apr_pool_mark(pool, &outer);
+    apr_pool_userdata_set("outer", "key", NULL, pool);
+    apr_pool_mark(pool, &inner);
+    for (n = 0; n < 64; n++) {
+        apr_pool_userdata_set("inner", apr_itoa(pool, n), NULL, pool);
+    }
+    apr_pool_userdata_setn("inner", "key", NULL, pool);
+    apr_pool_release_to_mark(pool, &inner);
+    apr_pool_userdata_get(&val, "key", pool);
+    ABTS_STR_EQUAL(tc, "outer", val);
+    apr_pool_userdata_get(&val, "1", pool);
+    ABTS_PTR_EQUAL(tc, NULL, val);
+    apr_pool_release_to_mark(pool, &outer);
+    apr_pool_userdata_get(&val, "key", pool);
+    ABTS_STR_EQUAL(tc, "old", val);
+
+    for (n = 0; n < 64; n++) {
+        apr_pool_userdata_set("after", apr_itoa(pool, n), NULL, pool);
+    }
+    apr_pool_userdata_get(&val, "63", pool);
+    ABTS_STR_EQUAL(tc, "after", val);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_FORK
+static void test_mark_subprocesses(abts_case *tc, void *data)
+{
+    apr_pool_mark_t mark;
+    apr_pool_t *pool;
+    apr_proc_t *proc, child;
+    apr_status_t rv;
+    char *mem;
+
+    apr_pool_create(&pool, p);
+    apr_pool_mark(pool, &mark);
+
+    proc = apr_palloc(pool, sizeof(*proc));
+    rv = apr_proc_fork(proc, pool);
+    if (rv == APR_INCHILD) {
+        apr_sleep(apr_time_from_sec(30));
+        exit(0);
+    }
+    ABTS_INT_EQUAL(tc, APR_INPARENT, rv);
+    apr_pool_note_subprocess(pool, proc, APR_KILL_ALWAYS);
+    child = *proc;
+
+    /* Killed and waited for on release, and forgotten */
+    apr_pool_release_to_mark(pool, &mark);
+    ABTS_ASSERT(tc, "subprocess still there",
+                apr_proc_kill(&child, 0) != APR_SUCCESS);
+    mem = apr_palloc(pool, ALLOC_BYTES);
+    memset(mem, 0xff, ALLOC_BYTES);
+
+    apr_pool_destroy(pool);
+}
+#endif
+
 static void test_tags(abts_case *tc, void *data)
 {
     /* if APR_POOL_DEBUG is set, all pools are tagged by default */
@@ -176,6 +446,385 @@ static void test_tags(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, "main pool", apr_pool_get_tag(pmain));
 }
 
+static int stats_walker(apr_pool_t *pool, const apr_pool_stats_t *stats,
+                        int depth, void *data)
+{
+    int *found = data;
+
+    if (depth == 1 && stats->tag && strcmp(stats->tag, "stats child") == 0
+        && stats->bytes_alloc >= ALLOC_BYTES * 64) {
+        (*found)++;
+    }
+    return 0;
+}
+
+static void test_palloc_grow(abts_case *tc, void *data)
+{
+    apr_pool_t *p;
+    apr_status_t rv;
+    char *mem, *grown, *other;
+    apr_size_t i;
+
+    rv = apr_pool_create(&p, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    mem = apr_palloc_grow(p, NULL, 0, 100);
+    ABTS_PTR_NOTNULL(tc, mem);
+    for (i = 0; i < 100; i++)
+        mem[i] = (char)i;
+
+    /* The last block grows in place */
+    grown = apr_palloc_grow(p, mem, 100, 200);
+#if !APR_POOL_DEBUG
+    ABTS_PTR_EQUAL(tc, mem, grown);
+#endif
+    mem = grown;
+    ABTS_PTR_EQUAL(tc, mem, apr_palloc_grow(p, mem, 200, 50));
+
+    /* Not the last one anymore, it is moved */
+    other = apr_palloc(p, 16);
+    ABTS_PTR_NOTNULL(tc, other);
+    grown = apr_palloc_grow(p, mem, 200, 400);
+    ABTS_PTR_NOTNULL(tc, grown);
+    ABTS_ASSERT(tc, "block not moved", grown != mem);
+    for (i = 0; i < 100; i++) {
+        if (grown[i] != (char)i)
+            break;
+    }
+    ABTS_SIZE_EQUAL(tc, 100, i);
+    mem = grown;
+
+    /* Too large for the node, moved and contents kept */
+    grown = apr_palloc_grow(p, mem, 400, 64 * ALLOC_BYTES);
+    ABTS_PTR_NOTNULL(tc, grown);
+    for (i = 0; i < 100; i++) {
+        if (grown[i] != (char)i)
+            break;
+    }
+    ABTS_SIZE_EQUAL(tc, 100, i);
+    memset(grown, 0, 64 * ALLOC_BYTES);
+
+    apr_pool_destroy(p);
+}
+
+static void test_stats(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t astats;
+    apr_pool_stats_t stats;
+    apr_pool_mark_t mark;
+    apr_pool_t *p, *sub;
+    apr_status_t rv;
+    apr_size_t n;
+    int i, found = 0;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&p, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, p);
+    apr_pool_tag(p, "stats");
+
+    for (i = 0; i < 20; i++) {
+        apr_palloc(p, ALLOC_BYTES * 4);
+    }
+    apr_pool_stats_get(p, &stats);
+    ABTS_STR_EQUAL(tc, "stats", stats.tag);
+    ABTS_TRUE(tc, stats.bytes_alloc >= ALLOC_BYTES * 80);
+    ABTS_TRUE(tc, stats.bytes_total >= stats.bytes_alloc + stats.bytes_wasted);
+    ABTS_TRUE(tc, stats.bytes_peak == stats.bytes_alloc);
+    ABTS_TRUE(tc, stats.nodes > 1);
+
+    rv = apr_pool_create(&sub, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_tag(sub, "stats child");
+    apr_palloc(sub, ALLOC_BYTES * 64);
+    ABTS_INT_EQUAL(tc, 0, apr_pool_stats_walk(p, stats_walker, &found));
+    ABTS_INT_EQUAL(tc, 1, found);
+
+    /* The peak survives a clear, and the nodes go to the allocator */
+    apr_pool_clear(p);
+    apr_pool_stats_get(p, &stats);
+    ABTS_INT_EQUAL(tc, 1, stats.nodes);
+    ABTS_TRUE(tc, stats.bytes_alloc < ALLOC_BYTES * 4);
+    ABTS_TRUE(tc, stats.bytes_peak >= ALLOC_BYTES * 80);
+
+    /* A higher peak released to a mark is still seen */
+    apr_pool_mark(p, &mark);
+    for (i = 0; i < 50; i++) {
+        apr_palloc(p, ALLOC_BYTES * 4);
+    }
+    apr_pool_release_to_mark(p, &mark);
+    apr_pool_stats_get(p, &stats);
+    ABTS_TRUE(tc, stats.bytes_alloc < ALLOC_BYTES * 4);
+    ABTS_TRUE(tc, stats.bytes_peak >= ALLOC_BYTES * 200);
+    apr_pool_clear(p);
+
+    apr_allocator_stats_get(allocator, &astats);
+    for (n = 0, i = 0; i < APR_ALLOCATOR_STATS_SLOTS; i++) {
+        n += astats.free_nodes[i];
+    }
+    ABTS_TRUE(tc, n > 0);
+    ABTS_TRUE(tc, astats.free_bytes >= ALLOC_BYTES * 64);
+    ABTS_INT_EQUAL(tc, 0, astats.max_free_hits);
+
+    apr_allocator_max_free_set(allocator, 1);
+    apr_palloc(p, ALLOC_BYTES * 64);
+    apr_pool_clear(p);
+    apr_allocator_stats_get(allocator, &astats);
+    ABTS_TRUE(tc, astats.max_free_hits > 0);
+
+    apr_pool_destroy(p);
+}
+
+static void test_hugepages(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *p, *sub;
+    apr_status_t rv;
+    char *mem;
+    int i;
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_HUGEPAGES);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "huge pages allocator");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Arena nodes must stay on the free lists whatever the threshold */
+    apr_allocator_max_free_set(allocator, 1);
+
+    rv = apr_pool_create_unmanaged_ex(&p, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, p);
+
+    for (i = 0; i < 64; i++) {
+        rv = apr_pool_create(&sub, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        /* Spans arenas, and includes oversized nodes */
+        mem = apr_palloc(sub, ALLOC_BYTES * (i + 1) * 4);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, 0xa, ALLOC_BYTES * (i + 1) * 4);
+        mem = apr_palloc(sub, ALLOC_BYTES * 8);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, 0xb, ALLOC_BYTES * 8);
+
+        if (i % 2)
+            apr_pool_destroy(sub);
+    }
+
+    apr_pool_destroy(p);
+}
+
+static void test_trim(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *p, *sub;
+    apr_status_t rv;
+    apr_size_t trimmed;
+    char *mem;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&p, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, p);
+
+    rv = apr_allocator_trim_set(allocator, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "allocator trimming");
+        apr_pool_destroy(p);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pool_create(&sub, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    mem = apr_palloc(sub, 16 * ALLOC_BYTES);
+    ABTS_PTR_NOTNULL(tc, mem);
+    memset(mem, 0xa, 16 * ALLOC_BYTES);
+    apr_pool_clear(sub);
+
+    /* The large node is idle, the second pass has nothing left to do */
+    trimmed = apr_allocator_trim(allocator);
+    ABTS_ASSERT(tc, "nothing trimmed", trimmed >= 8 * ALLOC_BYTES);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_allocator_trim(allocator));
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_ASSERT(tc, "trimmed bytes not accounted",
+                stats.trimmed_bytes >= trimmed
+                && stats.trimmed_bytes <= stats.free_bytes);
+
+    /* Trimmed nodes are reusable */
+    mem = apr_palloc(sub, 16 * ALLOC_BYTES);
+    ABTS_PTR_NOTNULL(tc, mem);
+    memset(mem, 0xb, 16 * ALLOC_BYTES);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.trimmed_bytes);
+
+    rv = apr_allocator_trim_set(allocator, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_clear(sub);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_allocator_trim(allocator));
+
+    apr_pool_destroy(p);
+}
+
+#if APR_HAS_THREADS
+
+#define TCACHE_THREADS    4
+#define TCACHE_ITERATIONS 1000
+
+static void *APR_THREAD_FUNC tcache_thread(apr_thread_t *thd, void *data)
+{
+    apr_allocator_t *allocator = data;
+    apr_pool_t *p;
+    int i;
+
+    for (i = 0; i < TCACHE_ITERATIONS; i++) {
+        if (apr_pool_create_unmanaged_ex(&p, NULL, allocator) != APR_SUCCESS)
+            break;
+        apr_palloc(p, ALLOC_BYTES);
+        apr_palloc(p, 8 * ALLOC_BYTES * (i % 4 + 1));
+        apr_pool_destroy(p);
+    }
+
+    apr_thread_exit(thd, i == TCACHE_ITERATIONS ? APR_SUCCESS : APR_ENOMEM);
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *t[TCACHE_THREADS];
+    apr_pool_t *owner;
+    apr_size_t hits, misses, hits2, misses2;
+    apr_status_t rv, ret;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&owner, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, owner);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_allocator_thread_cache_set(allocator, 8, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, tcache_thread, allocator, owner);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_join(&ret, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, ret);
+    }
+
+    apr_allocator_thread_cache_stats(allocator, &hits, &misses);
+    ABTS_TRUE(tc, misses > 0);
+    ABTS_TRUE(tc, hits > misses);
+    ABTS_TRUE(tc, hits + misses >= TCACHE_THREADS * TCACHE_ITERATIONS * 2);
+
+    /* Disabling keeps the statistics */
+    rv = apr_allocator_thread_cache_set(allocator, 0, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_thread_cache_stats(allocator, &hits2, &misses2);
+    ABTS_TRUE(tc, hits2 == hits && misses2 == misses);
+
+    apr_pool_destroy(owner);
+}
+
+typedef struct {
+    apr_os_thread_t thread;
+    volatile apr_uint32_t done;
+    apr_interval_time_t delay;
+} reaped_t;
+
+static apr_status_t reaped_cleanup(void *data)
+{
+    reaped_t *reaped = data;
+
+    if (reaped->delay)
+        apr_sleep(reaped->delay);
+    reaped->thread = apr_os_thread_current();
+    apr_atomic_set32(&reaped->done, 1);
+
+    return APR_SUCCESS;
+}
+
+static void test_destroy_deferred(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_pool_t *pool, *child, *owner;
+    reaped_t reaped, reaped_child;
+    apr_status_t rv;
+    int n;
+
+    memset(&reaped, 0, sizeof(reaped));
+    memset(&reaped_child, 0, sizeof(reaped_child));
+
+    apr_pool_create(&pool, p);
+    apr_pool_create(&child, pool);
+    apr_palloc(pool, ALLOC_BYTES * 64);
+    apr_pool_cleanup_register(pool, &reaped, reaped_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_register(child, &reaped_child, reaped_cleanup,
+                              apr_pool_cleanup_null);
+
+    apr_pool_destroy_deferred(pool);
+    for (n = 0; n < 500 && !apr_atomic_read32(&reaped.done); n++)
+        apr_sleep(apr_time_from_msec(10));
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&reaped.done));
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&reaped_child.done));
+#if !APR_POOL_DEBUG
+    ABTS_TRUE(tc, !apr_os_thread_equal(reaped.thread,
+                                       apr_os_thread_current()));
+#endif
+
+    /* Inline when the reaper can't take more */
+    memset(&reaped, 0, sizeof(reaped));
+    apr_pool_create(&pool, p);
+    apr_pool_cleanup_register(pool, &reaped, reaped_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_reaper_max_set(0);
+    apr_pool_destroy_deferred(pool);
+    apr_pool_reaper_max_set(APR_POOL_REAPER_MAX_DEFAULT);
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&reaped.done));
+    ABTS_TRUE(tc, apr_os_thread_equal(reaped.thread,
+                                      apr_os_thread_current()));
+
+    /* The owner of the allocator waits for the deferred pools using it */
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&owner, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, owner);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    memset(&reaped, 0, sizeof(reaped));
+    reaped.delay = apr_time_from_msec(100);
+    apr_pool_create(&pool, owner);
+    apr_pool_cleanup_register(pool, &reaped, reaped_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_destroy_deferred(pool);
+    apr_pool_destroy(owner);
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&reaped.done));
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -187,7 +836,23 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_cleanup_handles, NULL);
+    abts_run_test(suite, test_mark, NULL);
+    abts_run_test(suite, test_mark_pre_cleanups, NULL);
+    abts_run_test(suite, test_mark_userdata, NULL);
+#if APR_HAS_FORK
+    abts_run_test(suite, test_mark_subprocesses, NULL);
+#endif
     abts_run_test(suite, test_tags, NULL);
+    abts_run_test(suite, test_palloc_grow, NULL);
+    abts_run_test(suite, test_palloc_aligned, NULL);
+    abts_run_test(suite, test_stats, NULL);
+    abts_run_test(suite, test_hugepages, NULL);
+    abts_run_test(suite, test_trim, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+    abts_run_test(suite, test_destroy_deferred, NULL);
+#endif
 
     return suite;
 }
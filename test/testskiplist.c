@@ -190,6 +190,31 @@ static void skiplist_destroy(abts_case *tc, void *data)
     ABTS_TRUE(tc, NULL == apr_skiplist_getlist(skiplist));
 }
 
+static void skiplist_alloc_free(abts_case *tc, void *data)
+{
+    char *mem1, *mem2, *foreign;
+
+    mem1 = apr_skiplist_alloc(skiplist, 32);
+    ABTS_PTR_NOTNULL(tc, mem1);
+    apr_skiplist_free(skiplist, mem1);
+
+    /* Freed twice, or not allocated from the skip list: ignored */
+    apr_skiplist_free(skiplist, mem1);
+    foreign = apr_palloc(p, 64);
+    memset(foreign, 0xff, 64);
+    apr_skiplist_free(skiplist, foreign + 32);
+    memset(foreign, 0, 64);
+    apr_skiplist_free(skiplist, foreign + 32);
+
+    mem1 = apr_skiplist_alloc(skiplist, 32);
+    mem2 = apr_skiplist_alloc(skiplist, 32);
+    ABTS_PTR_NOTNULL(tc, mem1);
+    ABTS_PTR_NOTNULL(tc, mem2);
+    ABTS_ASSERT(tc, "same chunk allocated twice", mem1 != mem2);
+    apr_skiplist_free(skiplist, mem1);
+    apr_skiplist_free(skiplist, mem2);
+}
+
 static void skiplist_size(abts_case *tc, void *data)
 {
     const char *val;
@@ -533,6 +558,7 @@ abts_suite *testskiplist(abts_suite *suite)
     abts_run_test(suite, skiplist_add, NULL);
     abts_run_test(suite, skiplist_replace, NULL);
     abts_run_test(suite, skiplist_destroy, NULL);
+    abts_run_test(suite, skiplist_alloc_free, NULL);
     abts_run_test(suite, skiplist_size, NULL);
     abts_run_test(suite, skiplist_remove, NULL);
     abts_run_test(suite, skiplist_random_loop, NULL);
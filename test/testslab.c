@@ -0,0 +1,193 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_slab.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define NUM_OBJS 1000
+
+typedef struct {
+    int id;
+    char pad[52];
+} obj_t;
+
+static void test_create(abts_case *tc, void *data)
+{
+    apr_slab_t *slab;
+    apr_status_t rv;
+
+    rv = apr_slab_create(&slab, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_slab_create(&slab, 1, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, apr_slab_alloc(slab));
+    apr_slab_destroy(slab);
+}
+
+static void test_alloc_free(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    obj_t *objs[NUM_OBJS], *obj;
+    apr_status_t rv;
+    int i;
+
+    apr_pool_create(&pool, p);
+    rv = apr_slab_create(&slab, sizeof(obj_t), 0, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        objs[i] = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        objs[i]->id = i;
+    }
+    for (i = 0; i < NUM_OBJS; i++) {
+        if (objs[i]->id != i)
+            break;
+    }
+    ABTS_INT_EQUAL(tc, NUM_OBJS, i);
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_ASSERT(tc, "object size", stats.size >= sizeof(obj_t));
+    ABTS_SIZE_EQUAL(tc, NUM_OBJS, stats.objects);
+    ABTS_SIZE_EQUAL(tc, NUM_OBJS, stats.inuse);
+    ABTS_SIZE_EQUAL(tc, 0, stats.free);
+    ABTS_ASSERT(tc, "slabs", stats.slabs > 0
+                && stats.bytes >= stats.objects * stats.size);
+
+    /* Freed objects are reused first (LIFO) */
+    obj = objs[NUM_OBJS / 2];
+    apr_slab_free(slab, obj);
+    apr_slab_free(slab, NULL);
+    ABTS_PTR_EQUAL(tc, obj, apr_slab_alloc(slab));
+
+    for (i = 0; i < NUM_OBJS; i++)
+        apr_slab_free(slab, objs[i]);
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, NUM_OBJS, stats.free);
+    ABTS_SIZE_EQUAL(tc, 0, stats.inuse);
+
+    /* No new slab needed */
+    for (i = 0; i < NUM_OBJS; i++) {
+        objs[i] = apr_slab_calloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        ABTS_INT_EQUAL(tc, 0, objs[i]->id);
+    }
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, NUM_OBJS, stats.objects);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+
+static void * APR_THREAD_FUNC slab_thread(apr_thread_t *thd, void *data)
+{
+    apr_slab_t *slab = data;
+    obj_t *objs[64];
+    int i, j, failed = 0;
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        for (j = 0; j < 64; j++) {
+            if ((objs[j] = apr_slab_alloc(slab)) == NULL) {
+                failed = 1;
+                break;
+            }
+            objs[j]->id = j;
+        }
+        while (j--) {
+            if (objs[j]->id != j)
+                failed = 1;
+            apr_slab_free(slab, objs[j]);
+        }
+    }
+
+    apr_thread_exit(thd, failed ? APR_EGENERAL : APR_SUCCESS);
+    return NULL;
+}
+
+static void test_magazines(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[NUM_THREADS];
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&pool, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_slab_create(&slab, sizeof(obj_t), APR_SLAB_MAGAZINES, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, slab_thread, slab, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    /* The magazines went back to the cache with their threads */
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, stats.inuse);
+    ABTS_SIZE_EQUAL(tc, 0, stats.cached);
+    ABTS_SIZE_EQUAL(tc, stats.objects, stats.free);
+    ABTS_ASSERT(tc, "objects", stats.objects >= 64
+                && stats.objects <= NUM_THREADS * (64 + 32));
+
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testslab(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, test_create, NULL);
+    abts_run_test(suite, test_alloc_free, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_magazines, NULL);
+#endif
+
+    return suite;
+}
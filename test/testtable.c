@@ -42,6 +42,37 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_copy_hdr_push(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_array_header_t *arr, *copy;
+    int i, n, bad = 0;
+
+    apr_pool_create(&subp, p);
+
+    /* The shared elements must survive the growth of the array */
+    for (n = 300; n <= 900; n += 300) {
+        arr = apr_array_make(subp, 1, sizeof(int));
+        for (i = 0; i < n; i++) {
+            APR_ARRAY_PUSH(arr, int) = i;
+        }
+        copy = apr_array_copy_hdr(p, arr);
+        for (i = 0; i < 600; i++) {
+            APR_ARRAY_PUSH(arr, int) = -1;
+        }
+        for (i = 0; i < 64; i++) {
+            memset(apr_palloc(subp, 256), 0xff, 256);
+        }
+        for (i = 0; i < n; i++) {
+            if (APR_ARRAY_IDX(copy, i, int) != i)
+                bad++;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, bad);
+
+    apr_pool_destroy(subp);
+}
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -222,11 +253,89 @@ static void table_overlap3(abts_case *tc, void *data)
 
 }
 
+#define LARGE_NELTS 1000
+
+static int large_do_cb(void *rec, const char *key, const char *value)
+{
+    (*(int *)rec)++;
+    return 1;
+}
+
+static void table_large(abts_case *tc, void *data)
+{
+    apr_table_t *t1, *t2;
+    const apr_array_header_t *a;
+    apr_table_entry_t *elts;
+    const char *key;
+    int i, missing = 0, count = 0;
+
+    /* Enough entries with the same first letter for the hashed index */
+    t1 = apr_table_make(p, 1);
+    for (i = 0; i < LARGE_NELTS; i++) {
+        key = apr_psprintf(p, "X-Header-%d", i);
+        apr_table_add(t1, key, key);
+    }
+    apr_table_add(t1, "x-header-10", "dup");
+    ABTS_INT_EQUAL(tc, LARGE_NELTS + 1, apr_table_elts(t1)->nelts);
+
+    for (i = 0; i < LARGE_NELTS; i++) {
+        key = apr_psprintf(p, "x-HEADER-%d", i);
+        if (strcasecmp(apr_table_get(t1, key), key))
+            missing++;
+    }
+    ABTS_INT_EQUAL(tc, 0, missing);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t1, "X-Header-"));
+    ABTS_STR_EQUAL(tc, "X-Header-10,dup", apr_table_getm(p, t1, "X-Header-10"));
+
+    /* Order is preserved */
+    a = apr_table_elts(t1);
+    elts = (apr_table_entry_t *)a->elts;
+    ABTS_STR_EQUAL(tc, "X-Header-0", elts[0].key);
+    ABTS_STR_EQUAL(tc, "X-Header-999", elts[LARGE_NELTS - 1].key);
+    ABTS_STR_EQUAL(tc, "dup", elts[LARGE_NELTS].val);
+
+    apr_table_do(large_do_cb, &count, t1, "X-Header-10", NULL);
+    ABTS_INT_EQUAL(tc, 2, count);
+
+    apr_table_set(t1, "X-Header-10", "set");
+    ABTS_INT_EQUAL(tc, LARGE_NELTS, apr_table_elts(t1)->nelts);
+    ABTS_STR_EQUAL(tc, "set", apr_table_get(t1, "X-Header-10"));
+    ABTS_STR_EQUAL(tc, "X-Header-11", apr_table_get(t1, "X-Header-11"));
+
+    apr_table_unset(t1, "X-Header-20");
+    ABTS_INT_EQUAL(tc, LARGE_NELTS - 1, apr_table_elts(t1)->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t1, "X-Header-20"));
+    ABTS_STR_EQUAL(tc, "X-Header-21", apr_table_get(t1, "X-Header-21"));
+
+    apr_table_merge(t1, "X-Header-30", "merged");
+    apr_table_mergen(t1, "X-Header-new", "new");
+    ABTS_STR_EQUAL(tc, "X-Header-30, merged", apr_table_get(t1, "X-Header-30"));
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t1, "X-Header-new"));
+
+    t2 = apr_table_copy(p, t1);
+    apr_table_addn(t2, "X-Header-40", "copy");
+    ABTS_STR_EQUAL(tc, "X-Header-40,copy", apr_table_getm(p, t2, "X-Header-40"));
+    ABTS_STR_EQUAL(tc, "X-Header-40", apr_table_getm(p, t1, "X-Header-40"));
+
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, LARGE_NELTS, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "copy", apr_table_get(t2, "X-Header-40"));
+
+    t2 = apr_table_overlay(p, t1, t2);
+    ABTS_STR_EQUAL(tc, "X-Header-40,copy", apr_table_getm(p, t2, "X-Header-40"));
+
+    apr_table_clear(t1);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t1, "X-Header-1"));
+    apr_table_set(t1, "X-Header-1", "again");
+    ABTS_STR_EQUAL(tc, "again", apr_table_get(t1, "X-Header-1"));
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_copy_hdr_push, NULL);
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -239,6 +348,7 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
     abts_run_test(suite, table_overlap3, NULL);
+    abts_run_test(suite, table_large, NULL);
 
     return suite;
 }